@@ -0,0 +1,374 @@
+// Replays a corpus of recorded chunks through the per-vertex, batch and
+// bucketed lighting paths and reports their throughput, along with how often
+// each isomorphism group occurs in the corpus. Fails if the bucketed path
+// lights any chunk differently from the batch path.
+//
+//   light_kernel_replay [--corpus FILE] [--write-corpus FILE] [--chunks N]
+//                       [--side N] [--passes N] [--seed N]
+//
+// Without --corpus, a small procedurally generated terrain corpus is used.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <VoxelooGeometry/geometry.hpp>
+#include <VoxelooLightKernelry/light_batch.hpp>
+#include <VoxelooLightKernelry/light_chunk_io.hpp>
+#include <VoxelooLightKernelry/light_kernel.hpp>
+#include <VoxelooLightKernelry/light_mask.hpp>
+
+using namespace voxeloo;
+using namespace voxeloo::galois::lighting;
+
+namespace {
+
+struct Options {
+  std::string corpus;
+  std::string write_corpus;
+  uint32_t chunks = 64;
+  uint32_t side = 32;
+  uint32_t passes = 3;
+  uint32_t seed = 1;
+};
+
+float hash_noise(int x, int y, int z, uint32_t seed) {
+  uint32_t h = seed;
+  for (auto v : {x, y, z}) {
+    h ^= static_cast<uint32_t>(v) + 0x9e3779b9u + (h << 6) + (h >> 2);
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+  }
+  return (h & 0xffffff) / float(0xffffff);
+}
+
+float value_noise(float x, float y, float z, uint32_t seed) {
+  auto x0 = int(std::floor(x));
+  auto y0 = int(std::floor(y));
+  auto z0 = int(std::floor(z));
+  auto smooth = [](float t) { return t * t * (3 - 2 * t); };
+  auto fx = smooth(x - x0), fy = smooth(y - y0), fz = smooth(z - z0);
+  float ret = 0;
+  for (int dz : {0, 1}) {
+    for (int dy : {0, 1}) {
+      for (int dx : {0, 1}) {
+        auto w = (dx ? fx : 1 - fx) * (dy ? fy : 1 - fy) * (dz ? fz : 1 - fz);
+        ret += w * hash_noise(x0 + dx, y0 + dy, z0 + dz, seed);
+      }
+    }
+  }
+  return ret;
+}
+
+// Rolling hills with caves below the surface, lit by the sky above ground and
+// by scattered torches underground.
+LightChunkData generate_terrain_chunk(Vec3i origin, uint32_t side,
+                                      uint32_t seed) {
+  LightChunkData data;
+  data.origin = origin;
+  data.shape = {side, side, side};
+
+  auto shape = padded_shape(data.chunk());
+  data.samples.resize(layout_size(LightLayout::kLinear, shape));
+  data.occupancy.resize(layout_size(LightLayout::kLinear, shape));
+
+  auto height = [&](int x, int z) {
+    return 24.0f + 20.0f * value_noise(x / 32.0f, 0, z / 32.0f, seed) +
+           6.0f * value_noise(x / 8.0f, 1, z / 8.0f, seed);
+  };
+  auto torch = [&](int x, int y, int z) {
+    auto cx = x >> 3, cy = y >> 3, cz = z >> 3;
+    auto best = 0.0f;
+    for (int dz = -1; dz <= 1; dz += 1) {
+      for (int dy = -1; dy <= 1; dy += 1) {
+        for (int dx = -1; dx <= 1; dx += 1) {
+          if (hash_noise(cx + dx, cy + dy, cz + dz, seed + 1) > 0.15f) {
+            continue;
+          }
+          auto tx = 8.0f * (cx + dx) + 4, ty = 8.0f * (cy + dy) + 4;
+          auto tz = 8.0f * (cz + dz) + 4;
+          auto d = std::sqrt((x - tx) * (x - tx) + (y - ty) * (y - ty) +
+                             (z - tz) * (z - tz));
+          best = std::max(best, 1.0f - d / 10.0f);
+        }
+      }
+    }
+    return best;
+  };
+
+  traverse_layout(LightLayout::kLinear, shape, [&](Vec3u pos) {
+    auto x = origin.x + int(pos.x) - 1;
+    auto y = origin.y + int(pos.y) - 1;
+    auto z = origin.z + int(pos.z) - 1;
+    auto surface = height(x, z);
+    auto cave = y < surface - 4 &&
+                value_noise(x / 12.0f, y / 8.0f, z / 12.0f, seed + 2) > 0.62f;
+    auto solid = y < surface && !cave;
+
+    Vec3f sample{0.0, 0.0, 0.0};
+    if (!solid) {
+      auto depth = surface - y;
+      auto sky = depth <= 0 ? 1.0f : std::max(0.0f, 1.0f - depth / 16);
+      auto block = torch(x, y, z);
+      sample = {std::max(sky, block), std::max(sky, 0.7f * block),
+                std::max(sky, 0.4f * block)};
+    }
+
+    auto index = layout_index(LightLayout::kLinear, shape, pos);
+    data.samples[index] = sample;
+    data.occupancy[index] = solid;
+  });
+  return data;
+}
+
+std::vector<LightChunkData> generate_terrain_corpus(const Options &options) {
+  std::vector<LightChunkData> corpus;
+  auto side = int(options.side);
+  for (uint32_t i = 0; i < options.chunks; i += 1) {
+    // Walk columns of chunks spanning the surface, 4 chunks wide.
+    auto column = int(i / 2), level = int(i % 2);
+    Vec3i origin{side * (column % 4), side * level, side * (column / 4)};
+    corpus.push_back(
+        generate_terrain_chunk(origin, options.side, options.seed));
+  }
+  return corpus;
+}
+
+// Lights each vertex on its own through the per-vertex kernel, in plain
+// x-y-z order.
+void light_per_vertex(const LightChunk &chunk, PackedLightMask *out) {
+  auto shape = chunk.shape;
+  Vec3u vertex_shape{shape.x + 1, shape.y + 1, shape.z + 1};
+  traverse_layout(LightLayout::kLinear, vertex_shape, [&](Vec3u pos) {
+    std::array<Vec3f, 8> samples;
+    auto occlusion_mask = gather_vertex(chunk, pos, samples);
+    auto mask = apply_light_kernel_with_occlusion<PackedLightMask>(
+        occlusion_mask, samples);
+    scatter_vertex(mask, pos, shape, LightLayout::kLinear, out);
+  });
+}
+
+void run(const std::string &name, const std::vector<LightChunkData> &corpus,
+         uint32_t passes, LightLayout layout,
+         const std::function<void(const LightChunk &, PackedLightMask *)> &fn) {
+  std::vector<std::vector<Vec3f>> samples(corpus.size());
+  std::vector<std::vector<uint8_t>> occupancy(corpus.size());
+  std::vector<std::vector<PackedLightMask>> out(corpus.size());
+  size_t vertices = 0;
+  for (size_t i = 0; i < corpus.size(); i += 1) {
+    relayout_light_chunk(corpus[i], layout, samples[i], occupancy[i]);
+    out[i].resize(layout_size(layout, corpus[i].shape));
+    auto shape = corpus[i].shape;
+    vertices += size_t(shape.x + 1) * (shape.y + 1) * (shape.z + 1);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t pass = 0; pass < passes; pass += 1) {
+    for (size_t i = 0; i < corpus.size(); i += 1) {
+      LightChunk chunk{corpus[i].shape, layout, samples[i].data(),
+                       occupancy[i].data()};
+      fn(chunk, out[i].data());
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  // Fold the output into a checksum so the work cannot be optimized away.
+  uint64_t checksum = 0;
+  for (const auto &masks : out) {
+    for (const auto &mask : masks) {
+      checksum = checksum * 31 + mask.corner(0) + mask.corner(7);
+    }
+  }
+
+  auto seconds = elapsed.count();
+  std::cout << std::left << std::setw(20) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(12)
+            << passes * corpus.size() / seconds << " chunks/s"
+            << std::setw(16) << passes * vertices / seconds / 1e6
+            << " Mvertices/s" << "  checksum " << std::hex << checksum
+            << std::dec << "\n";
+}
+
+// Checks that the bucketed path lights the corpus exactly as the batch path
+// does, in every layout.
+template <typename LightMask>
+bool check_bucketed(const std::vector<LightChunkData> &corpus,
+                    const std::string &mask_name) {
+  std::vector<Vec3f> samples;
+  std::vector<uint8_t> occupancy;
+  std::vector<LightMask> expected;
+  std::vector<LightMask> actual;
+  bool ok = true;
+  for (auto layout : {LightLayout::kLinear, LightLayout::kMorton,
+                      LightLayout::kBrick4, LightLayout::kBrick8}) {
+    size_t mismatches = 0;
+    for (const auto &data : corpus) {
+      relayout_light_chunk(data, layout, samples, occupancy);
+      LightChunk chunk{data.shape, layout, samples.data(), occupancy.data()};
+      expected.assign(layout_size(layout, data.shape), LightMask{});
+      actual.assign(layout_size(layout, data.shape), LightMask{});
+      apply_light_kernel_batch(chunk, expected.data(), layout);
+      apply_light_kernel_batch_bucketed(chunk, actual.data(), layout);
+      traverse_layout(LightLayout::kLinear, data.shape, [&](Vec3u pos) {
+        auto index = layout_index(layout, data.shape, pos);
+        for (uint32_t corner = 0; corner < 8; corner += 1) {
+          Vec3u corner_pos{corner & 1, (corner >> 1) & 1, corner >> 2};
+          auto a = expected[index].get(corner_pos);
+          auto b = actual[index].get(corner_pos);
+          bool same = a.x == b.x && a.y == b.y && a.z == b.z;
+          if constexpr (is_occlusion_light_mask_v<LightMask>) {
+            same &= expected[index].component_size(corner_pos) ==
+                    actual[index].component_size(corner_pos);
+          }
+          if (!same) {
+            mismatches += 1;
+            break;
+          }
+        }
+      });
+    }
+    if (mismatches) {
+      std::cerr << "bucketed " << mask_name << " differs from batch in "
+                << mismatches << " voxels of layout "
+                << static_cast<int>(layout) << "\n";
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void print_group_histogram(const std::vector<LightChunkData> &corpus) {
+  std::array<uint64_t, 22> counts = {};
+  uint64_t total = 0;
+  for (const auto &data : corpus) {
+    auto chunk = data.chunk();
+    auto shape = chunk.shape;
+    Vec3u vertex_shape{shape.x + 1, shape.y + 1, shape.z + 1};
+    traverse_layout(LightLayout::kLinear, vertex_shape, [&](Vec3u pos) {
+      std::array<Vec3f, 8> samples;
+      counts[kMaskToGroupLut[gather_vertex(chunk, pos, samples)]] += 1;
+      total += 1;
+    });
+  }
+
+  std::cout << "group histogram over " << total << " vertices\n";
+  for (size_t group = 0; group < counts.size(); group += 1) {
+    std::cout << std::setw(4) << group << std::setw(14) << counts[group]
+              << std::fixed << std::setprecision(3) << std::setw(10)
+              << 100.0 * counts[group] / std::max<uint64_t>(total, 1)
+              << " %\n";
+  }
+}
+
+bool try_parse_options(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i += 1) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--corpus") {
+      options.corpus = value;
+    } else if (arg == "--write-corpus") {
+      options.write_corpus = value;
+    } else if (arg == "--chunks") {
+      options.chunks = std::stoul(value);
+    } else if (arg == "--side") {
+      options.side = std::stoul(value);
+    } else if (arg == "--passes") {
+      options.passes = std::stoul(value);
+    } else if (arg == "--seed") {
+      options.seed = std::stoul(value);
+    } else {
+      return false;
+    }
+  }
+  // Generated chunks must also fit the corpus format so --write-corpus
+  // output can be read back.
+  return options.chunks > 0 && options.side > 0 &&
+         options.side <= kMaxLightChunkSide && options.passes > 0;
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+  try {
+    return try_parse_options(argc, argv, options);
+  } catch (const std::exception &) {
+    // std::stoul throws on malformed and out of range numbers.
+    return false;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    std::cerr << "usage: light_kernel_replay [--corpus FILE] "
+                 "[--write-corpus FILE] [--chunks N] [--side N] [--passes N] "
+                 "[--seed N]\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<LightChunkData> corpus;
+  if (options.corpus.empty()) {
+    corpus = generate_terrain_corpus(options);
+  } else {
+    std::ifstream in(options.corpus, std::ios::binary);
+    corpus = read_light_corpus(in);
+    if (corpus.empty()) {
+      std::cerr << "No chunks read from " << options.corpus << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (!options.write_corpus.empty()) {
+    std::ofstream out(options.write_corpus, std::ios::binary);
+    for (const auto &data : corpus) {
+      write_light_chunk(out, data);
+    }
+  }
+
+  std::cout << "replaying " << corpus.size() << " chunks, " << options.passes
+            << " passes\n";
+  run("per-vertex", corpus, options.passes, LightLayout::kLinear,
+      light_per_vertex);
+  for (auto [name, layout] : {
+           std::pair{"batch linear", LightLayout::kLinear},
+           std::pair{"batch morton", LightLayout::kMorton},
+           std::pair{"batch brick4", LightLayout::kBrick4},
+           std::pair{"batch brick8", LightLayout::kBrick8},
+       }) {
+    run(name, corpus, options.passes, layout,
+        [layout = layout](const LightChunk &chunk, PackedLightMask *out) {
+          apply_light_kernel_batch(chunk, out, layout);
+        });
+  }
+  run("batch bucketed", corpus, options.passes, LightLayout::kLinear,
+      [](const LightChunk &chunk, PackedLightMask *out) {
+        apply_light_kernel_batch_bucketed(chunk, out);
+      });
+  print_group_histogram(corpus);
+
+  auto packed_ok = check_bucketed<PackedLightMask>(corpus, "PackedLightMask");
+  auto deferred_ok =
+      check_bucketed<DeferredLightMask>(corpus, "DeferredLightMask");
+  auto occlusion_ok = check_bucketed<PackedLightOcclusionMask>(
+      corpus, "PackedLightOcclusionMask");
+  if (!packed_ok || !deferred_ok || !occlusion_ok) {
+    return EXIT_FAILURE;
+  }
+  std::cout << "bucketed output matches batch in every layout\n";
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,432 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <VoxelooGeometry/geometry.hpp>
+#include <VoxelooLightKernelry/light_batch_fwd.hpp>
+#include <VoxelooLightKernelry/light_chunk.hpp>
+#include <VoxelooLightKernelry/light_delta.hpp>
+#include <VoxelooLightKernelry/light_kernel.hpp>
+#include <VoxelooLightKernelry/light_layout.hpp>
+#include <VoxelooLightKernelry/light_mask.hpp>
+#include <VoxelooLightKernelry/light_stats.hpp>
+
+namespace voxeloo::galois::lighting {
+
+// Reads the 2x2x2 voxel neighbourhood of the vertex at pos, where vertex
+// (0, 0, 0) is the minimum corner of chunk voxel (0, 0, 0), from the inputs
+// indexed by index over the padded shape. Returns the occlusion mask of the
+// neighbourhood.
+template <LightLayout kLayout>
+inline auto gather_vertex(const LightChunk &chunk,
+                          const LightLayoutIndexer<kLayout> &index, Vec3u pos,
+                          std::array<Vec3f, 8> &samples) {
+  size_t x[2] = {index.template axis<0>(pos.x),
+                 index.template axis<0>(pos.x + 1)};
+  size_t y[2] = {index.template axis<1>(pos.y),
+                 index.template axis<1>(pos.y + 1)};
+  size_t z[2] = {index.template axis<2>(pos.z),
+                 index.template axis<2>(pos.z + 1)};
+  uint8_t occlusion_mask = 0;
+  for (auto dz : {0u, 1u}) {
+    for (auto dy : {0u, 1u}) {
+      for (auto dx : {0u, 1u}) {
+        auto i = dx + 2 * (dy + 2 * dz);
+        auto offset = x[dx] + y[dy] + z[dz];
+        samples[i] = chunk.samples[offset];
+        if (!chunk.occupancy[offset]) {
+          occlusion_mask |= 1 << (7 - i);
+        }
+      }
+    }
+  }
+  return occlusion_mask;
+}
+
+template <LightLayout kLayout>
+inline auto gather_vertex(const LightChunk &chunk, Vec3u pos,
+                          std::array<Vec3f, 8> &samples) {
+  return gather_vertex(
+      chunk, LightLayoutIndexer<kLayout>(padded_shape(chunk)), pos, samples);
+}
+
+inline auto gather_vertex(const LightChunk &chunk, Vec3u pos,
+                          std::array<Vec3f, 8> &samples) {
+  return dispatch_layout(chunk.layout, [&](auto kLayout) {
+    return gather_vertex<kLayout>(chunk, pos, samples);
+  });
+}
+
+// Returns a corner value packed as by PackedLightMask::pack, quantizing it
+// first if the mask defers quantization.
+template <typename Value>
+inline auto pack_light_value(const Value &value) {
+  if constexpr (std::is_same_v<Value, Vec3f>) {
+    return PackedLightMask::pack(quantize_light_value(value));
+  } else {
+    return PackedLightMask::pack(value);
+  }
+}
+
+// Writes each corner of the vertex light mask at pos to the corresponding
+// corner of the chunk voxel it belongs to, in out indexed by index over shape.
+// Corners outside the chunk are dropped. Corners whose value changes are
+// recorded to delta, if given. Pass nullptr rather than a null LightDelta
+// pointer to leave delta out without testing for it at every corner.
+template <LightLayout kLayout, typename LightMask,
+          typename Delta = std::nullptr_t>
+inline void scatter_vertex(const LightMask &mask, Vec3u pos, Vec3u shape,
+                           const LightLayoutIndexer<kLayout> &index,
+                           LightMask *out, Delta delta = nullptr) {
+  // A change to only the component size of a corner would go missing.
+  static_assert(std::is_null_pointer_v<Delta> ||
+                    !is_occlusion_light_mask_v<LightMask>,
+                "light deltas only carry light, not component sizes");
+  // The corners belong to the voxels at pos - 1 + {dx, dy, dz}. Unsigned
+  // wraparound puts the voxels before the chunk out of range with the ones
+  // after it, and their unused axis terms are harmless.
+  uint32_t vx[2] = {pos.x - 1, pos.x};
+  uint32_t vy[2] = {pos.y - 1, pos.y};
+  uint32_t vz[2] = {pos.z - 1, pos.z};
+  size_t x[2] = {index.template axis<0>(vx[0]), index.template axis<0>(vx[1])};
+  size_t y[2] = {index.template axis<1>(vy[0]), index.template axis<1>(vy[1])};
+  size_t z[2] = {index.template axis<2>(vz[0]), index.template axis<2>(vz[1])};
+  for (auto dz : {0u, 1u}) {
+    for (auto dy : {0u, 1u}) {
+      for (auto dx : {0u, 1u}) {
+        if (vx[dx] >= shape.x || vy[dy] >= shape.y || vz[dz] >= shape.z) {
+          continue;
+        }
+        auto &dst = out[x[dx] + y[dy] + z[dz]];
+        auto value = mask.get({dx, dy, dz});
+        if constexpr (!std::is_null_pointer_v<Delta>) {
+          auto bits = pack_light_value(value);
+          if (bits != pack_light_value(dst.get({1 - dx, 1 - dy, 1 - dz}))) {
+            auto voxel = layout_index<LightLayout::kLinear>(
+                shape, {vx[dx], vy[dy], vz[dz]});
+            delta->record(voxel, 7 - (dx + 2 * (dy + 2 * dz)), bits);
+          }
+        }
+        dst.set({1 - dx, 1 - dy, 1 - dz}, value);
+        if constexpr (is_occlusion_light_mask_v<LightMask>) {
+          dst.set_component_size(1 << (7 - (dx + 2 * (dy + 2 * dz))),
+                                 mask.component_size({dx, dy, dz}));
+        }
+      }
+    }
+  }
+}
+
+template <typename LightMask, typename Delta = std::nullptr_t>
+inline void scatter_vertex(const LightMask &mask, Vec3u pos, Vec3u shape,
+                           LightLayout layout, LightMask *out,
+                           Delta delta = nullptr) {
+  dispatch_layout(layout, [&](auto kLayout) {
+    LightLayoutIndexer<kLayout> index(shape);
+    if constexpr (std::is_null_pointer_v<Delta>) {
+      scatter_vertex(mask, pos, shape, index, out);
+    } else if (delta) {
+      scatter_vertex(mask, pos, shape, index, out, delta);
+    } else {
+      scatter_vertex(mask, pos, shape, index, out);
+    }
+  });
+}
+
+// Fills stats with the statistics of the light masks of a chunk of the given
+// shape, stored in the given layout, in one pass over them.
+template <typename LightMask>
+void compute_light_stats(const LightMask *masks, Vec3u shape,
+                         LightLayout layout, LightStats &stats) {
+  stats.clear(shape);
+  dispatch_layout(layout, [&](auto kLayout) {
+    LightLayoutIndexer<kLayout> index(shape);
+    for (uint32_t z = 0; z < shape.z; z += 1) {
+      for (uint32_t y = 0; y < shape.y; y += 1) {
+        auto row = index.template axis<1>(y) + index.template axis<2>(z);
+        for (uint32_t x = 0; x < shape.x; x += 1) {
+          const auto &mask = masks[row + index.template axis<0>(x)];
+          std::array<uint16_t, 8> corners;
+          for (uint32_t i = 0; i < 8; i += 1) {
+            corners[i] =
+                pack_light_value(mask.get({i & 1, (i >> 1) & 1, i >> 2}));
+          }
+          stats.record({x, y, z}, corners);
+        }
+      }
+    }
+  });
+  stats.finish();
+}
+
+// A run of consecutive vertices of a batch relight. The batch kernel gathers,
+// lights and scatters a run at a time, so the loops that depend on the layouts
+// and the outputs stay apart from the kernel, which is instantiated once per
+// mask type rather than once per combination of them.
+template <typename LightMask>
+struct LightVertexRun {
+  static constexpr size_t kCapacity = 64;
+
+  size_t count = 0;
+  std::array<Vec3u, kCapacity> positions;
+  std::array<uint8_t, kCapacity> occlusion_masks;
+  std::array<std::array<Vec3f, 8>, kCapacity> samples;
+  std::array<LightMask, kCapacity> masks;
+};
+
+template <typename LightMask>
+inline void gather_vertex_run(const LightChunk &chunk,
+                              LightVertexRun<LightMask> &run) {
+  dispatch_layout(chunk.layout, [&](auto kLayout) {
+    LightLayoutIndexer<kLayout> index(padded_shape(chunk));
+    for (size_t n = 0; n < run.count; n += 1) {
+      run.occlusion_masks[n] =
+          gather_vertex(chunk, index, run.positions[n], run.samples[n]);
+    }
+  });
+}
+
+template <typename LightMask>
+inline void light_vertex_run(LightVertexRun<LightMask> &run) {
+  for (size_t n = 0; n < run.count; n += 1) {
+    run.masks[n] = run.occlusion_masks[n] == 0xff
+                       ? apply_light_kernel<LightMask>(run.samples[n])
+                       : apply_light_kernel_with_occlusion<LightMask>(
+                             run.occlusion_masks[n], run.samples[n]);
+  }
+}
+
+template <typename LightMask, typename Delta>
+inline void scatter_vertex_run(const LightVertexRun<LightMask> &run,
+                               Vec3u shape, LightLayout layout, LightMask *out,
+                               Delta delta) {
+  dispatch_layout(layout, [&](auto kLayout) {
+    LightLayoutIndexer<kLayout> index(shape);
+    auto scatter = [&](auto delta) {
+      for (size_t n = 0; n < run.count; n += 1) {
+        scatter_vertex(run.masks[n], run.positions[n], shape, index, out,
+                       delta);
+      }
+    };
+    if constexpr (std::is_null_pointer_v<Delta>) {
+      scatter(nullptr);
+    } else if (delta) {
+      scatter(delta);
+    } else {
+      scatter(nullptr);
+    }
+  });
+}
+
+// Lights the chunk a run of vertices at a time, in the storage order of
+// out_layout, with light(run) lighting each gathered run.
+template <typename LightMask, typename Delta, typename Light>
+void apply_light_kernel_runs(const LightChunk &chunk, LightMask *out,
+                             LightLayout out_layout, Delta delta,
+                             LightStats *stats, Light &&light) {
+  constexpr bool kWithDelta = !std::is_null_pointer_v<Delta>;
+  if constexpr (kWithDelta) {
+    if (delta) {
+      delta->clear();
+    }
+  }
+
+  auto shape = chunk.shape;
+  Vec3u vertex_shape{shape.x + 1, shape.y + 1, shape.z + 1};
+  LightVertexRun<LightMask> run;
+  auto flush = [&] {
+    gather_vertex_run(chunk, run);
+    light(run);
+    scatter_vertex_run(run, shape, out_layout, out, delta);
+    run.count = 0;
+  };
+  traverse_layout(out_layout, vertex_shape, [&](Vec3u pos) {
+    run.positions[run.count++] = pos;
+    if (run.count == run.positions.size()) {
+      flush();
+    }
+  });
+  flush();
+
+  if constexpr (kWithDelta) {
+    if (delta) {
+      delta->finish();
+    }
+  }
+  if (stats) {
+    compute_light_stats(out, shape, out_layout, *stats);
+  }
+}
+
+// Lights every vertex of the chunk and writes the result as one light mask per
+// voxel, holding the light value at each of its 8 corners. The output must
+// hold layout_size(out_layout, chunk.shape) elements. Vertices are visited in
+// the storage order of out_layout. On the 32^3 terrain of light_kernel_replay
+// the linear and brick layouts run at about the same speed and Morton at about
+// three quarters of it, since chunks that small stay in cache in any layout and
+// Morton has the most index math. Prefer kLinear unless the consumer needs
+// another layout.
+//
+// If delta is given, it is cleared and then filled with the corners whose
+// value differs from what out held before, compared after quantization.
+// Deltas only carry light, so passing a LightDelta with an occlusion mask
+// fails to compile rather than dropping component size changes; pass nullptr.
+// If stats is given, it is filled by compute_light_stats once out is written.
+template <typename LightMask, typename Delta>
+void apply_light_kernel_batch(const LightChunk &chunk, LightMask *out,
+                              LightLayout out_layout, Delta delta,
+                              LightStats *stats) {
+  apply_light_kernel_runs(chunk, out, out_layout, delta, stats,
+                          [](auto &run) { light_vertex_run(run); });
+}
+
+// For each occlusion mask, the sample of a neighbourhood that each sample of
+// its isomorphism group's version is taken from, which folds the permutation
+// and reflection of transform_samples into the indices of a gather.
+inline const auto &group_sample_lut() {
+  static const auto lut = [] {
+    std::array<Vec3f, 8> samples;
+    for (uint32_t i = 0; i < 8; i += 1) {
+      samples[i] = {float(i), 0.0, 0.0};
+    }
+    std::array<std::array<uint8_t, 8>, 256> lut;
+    for (uint32_t mask = 0; mask < 256; mask += 1) {
+      auto group_samples = transform_samples(samples, mask);
+      for (uint32_t i = 0; i < 8; i += 1) {
+        lut[mask][i] = static_cast<uint8_t>(group_samples[i].x);
+      }
+    }
+    return lut;
+  }();
+  return lut;
+}
+
+// Lights the vertices of a run whose occlusion masks all belong to the
+// isomorphism group kGroup. The group is a constant, so the kernel reduces to
+// that group's straight-line case; only the gather indices and the corner
+// permutation of the result vary per vertex.
+template <int kGroup, typename LightMask>
+void light_group_bucket(LightVertexRun<LightMask> &run, const uint8_t *vertices,
+                        size_t count) {
+  const auto &lut = group_sample_lut();
+  for (size_t k = 0; k < count; k += 1) {
+    auto n = vertices[k];
+    auto occlusion_mask = run.occlusion_masks[n];
+    std::array<Vec3f, 8> samples;
+    for (uint32_t i = 0; i < 8; i += 1) {
+      samples[i] = run.samples[n][lut[occlusion_mask][i]];
+    }
+    auto out = transform_mask<LightMask>(
+        group_mask<LightMask>(samples, kGroup), occlusion_mask);
+    if constexpr (is_occlusion_light_mask_v<LightMask>) {
+      set_component_sizes(out, occlusion_mask);
+    }
+    run.masks[n] = out;
+  }
+}
+
+// Open vertices take apply_light_kernel, as in apply_light_kernel_batch.
+template <typename LightMask>
+void light_open_bucket(LightVertexRun<LightMask> &run, const uint8_t *vertices,
+                       size_t count) {
+  for (size_t k = 0; k < count; k += 1) {
+    auto n = vertices[k];
+    run.masks[n] = apply_light_kernel<LightMask>(run.samples[n]);
+  }
+}
+
+static constexpr size_t kLightGroupCount = 22;
+
+template <typename LightMask, int... kGroup>
+constexpr auto make_group_bucket_lut(std::integer_sequence<int, kGroup...>) {
+  using Fn = void (*)(LightVertexRun<LightMask> &, const uint8_t *, size_t);
+  return std::array<Fn, kLightGroupCount + 1>{
+      &light_group_bucket<kGroup, LightMask>..., &light_open_bucket<LightMask>};
+}
+
+// Lights a gathered run bucketed by isomorphism group, with open vertices in a
+// bucket of their own.
+template <typename LightMask>
+void light_vertex_run_bucketed(LightVertexRun<LightMask> &run) {
+  static constexpr auto kBucketLut = make_group_bucket_lut<LightMask>(
+      std::make_integer_sequence<int, kLightGroupCount>{});
+
+  std::array<uint8_t, LightVertexRun<LightMask>::kCapacity> buckets, order;
+  std::array<uint8_t, kLightGroupCount + 2> offsets = {};
+  for (size_t n = 0; n < run.count; n += 1) {
+    auto occlusion_mask = run.occlusion_masks[n];
+    buckets[n] = occlusion_mask == 0xff ? kLightGroupCount
+                                        : kMaskToGroupLut[occlusion_mask];
+    offsets[buckets[n] + 1] += 1;
+  }
+  for (size_t i = 1; i < offsets.size(); i += 1) {
+    offsets[i] += offsets[i - 1];
+  }
+  auto cursor = offsets;
+  for (size_t n = 0; n < run.count; n += 1) {
+    order[cursor[buckets[n]]++] = static_cast<uint8_t>(n);
+  }
+  for (size_t i = 0; i <= kLightGroupCount; i += 1) {
+    if (auto count = offsets[i + 1] - offsets[i]) {
+      kBucketLut[i](run, &order[offsets[i]], count);
+    }
+  }
+}
+
+// Produces the same output as apply_light_kernel_batch, but lights each run of
+// vertices bucketed by isomorphism group, with a loop specialized to each
+// group, so the kernel never branches on the group. On the terrain of
+// light_kernel_replay this runs at about the speed of apply_light_kernel_batch
+// rather than faster, so it is not part of the precompiled library.
+template <typename LightMask, typename Delta = std::nullptr_t>
+void apply_light_kernel_batch_bucketed(
+    const LightChunk &chunk, LightMask *out,
+    LightLayout out_layout = LightLayout::kLinear, Delta delta = nullptr,
+    LightStats *stats = nullptr) {
+  apply_light_kernel_runs(chunk, out, out_layout, delta, stats,
+                          [](auto &run) { light_vertex_run_bucketed(run); });
+}
+
+// Quantizes light masks produced by lighting into DeferredLightMask, scaling
+// each light channel first. This is a single linear pass over the chunk, so
+// changing a global brightness such as the sky's does not rerun the kernel,
+// provided that brightness owns whole channels (see DeferredLightMask).
+// Corners quantizing to the same value are written together with the bulk
+// mask operations, so uniformly lit voxels take a single write.
+template <typename LightMask>
+void quantize_light_batch(const DeferredLightMask *in, size_t count,
+                          Vec3f scale, LightMask *out) {
+  for (size_t i = 0; i < count; i += 1) {
+    std::array<Vec3u, 8> values;
+    for (uint32_t j = 0; j < 8; j += 1) {
+      const auto &value = in[i].corner(j);
+      values[j] = quantize_light_value(
+          {value.x * scale.x, value.y * scale.y, value.z * scale.z});
+    }
+    LightMask mask;
+    uint8_t todo = 0xff;
+    for (uint32_t j = 0; j < 8; j += 1) {
+      if (!(todo & (1 << j))) {
+        continue;
+      }
+      const auto &value = values[j];
+      uint8_t corners = 0;
+      for (uint32_t k = j; k < 8; k += 1) {
+        const auto &other = values[k];
+        if (other.x == value.x && other.y == value.y && other.z == value.z) {
+          corners |= 1 << k;
+        }
+      }
+      set_corners(mask, corners, value);
+      todo &= ~corners;
+    }
+    out[i] = mask;
+  }
+}
+
+} // namespace voxeloo::galois::lighting
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <VoxelooGeometry/geometry.hpp>
+#include <VoxelooLightKernelry/light_chunk.hpp>
+#include <VoxelooLightKernelry/light_delta.hpp>
+#include <VoxelooLightKernelry/light_layout.hpp>
+#include <VoxelooLightKernelry/light_mask.hpp>
+#include <VoxelooLightKernelry/light_stats.hpp>
+
+// Declarations of the batch lighting API, without the generated kernel. When
+// linking the precompiled VoxelooLightKernelryCompiled library, this is all a
+// translation unit needs to light the library provided mask types, and the
+// instantiations below are taken from the library rather than rebuilt. Other
+// mask types need light_batch.hpp, which holds the definitions.
+
+namespace voxeloo::galois::lighting {
+
+// Delta is std::nullptr_t or LightDelta *, see light_batch.hpp.
+template <typename LightMask, typename Delta = std::nullptr_t>
+void apply_light_kernel_batch(const LightChunk &chunk, LightMask *out,
+                              LightLayout out_layout = LightLayout::kLinear,
+                              Delta delta = nullptr,
+                              LightStats *stats = nullptr);
+
+template <typename LightMask>
+void compute_light_stats(const LightMask *masks, Vec3u shape,
+                         LightLayout layout, LightStats &stats);
+
+template <typename LightMask>
+void quantize_light_batch(const DeferredLightMask *in, size_t count,
+                          Vec3f scale, LightMask *out);
+
+#ifdef VOXELOO_LIGHT_KERNELRY_PRECOMPILED
+extern template void apply_light_kernel_batch<PackedLightMask>(
+    const LightChunk &, PackedLightMask *, LightLayout, std::nullptr_t,
+    LightStats *);
+extern template void apply_light_kernel_batch<PackedLightMask>(
+    const LightChunk &, PackedLightMask *, LightLayout, LightDelta *,
+    LightStats *);
+extern template void apply_light_kernel_batch<DeferredLightMask>(
+    const LightChunk &, DeferredLightMask *, LightLayout, std::nullptr_t,
+    LightStats *);
+extern template void apply_light_kernel_batch<DeferredLightMask>(
+    const LightChunk &, DeferredLightMask *, LightLayout, LightDelta *,
+    LightStats *);
+extern template void apply_light_kernel_batch<PackedLightOcclusionMask>(
+    const LightChunk &, PackedLightOcclusionMask *, LightLayout,
+    std::nullptr_t, LightStats *);
+extern template void compute_light_stats<PackedLightMask>(
+    const PackedLightMask *, Vec3u, LightLayout, LightStats &);
+extern template void compute_light_stats<DeferredLightMask>(
+    const DeferredLightMask *, Vec3u, LightLayout, LightStats &);
+extern template void compute_light_stats<PackedLightOcclusionMask>(
+    const PackedLightOcclusionMask *, Vec3u, LightLayout, LightStats &);
+extern template void quantize_light_batch<PackedLightMask>(
+    const DeferredLightMask *, size_t, Vec3f, PackedLightMask *);
+#endif
+
+} // namespace voxeloo::galois::lighting
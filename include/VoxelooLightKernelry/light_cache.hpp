@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <VoxelooGeometry/geometry.hpp>
+#ifdef VOXELOO_LIGHT_KERNELRY_PRECOMPILED
+#include <VoxelooLightKernelry/light_batch_fwd.hpp>
+#else
+#include <VoxelooLightKernelry/light_batch.hpp>
+#endif
+#include <VoxelooLightKernelry/light_chunk.hpp>
+#include <VoxelooLightKernelry/light_layout.hpp>
+
+namespace voxeloo::galois::lighting {
+
+// A 128-bit digest of the inputs of a chunk relight.
+struct LightChunkHash {
+  uint64_t lo = 0;
+  uint64_t hi = 0;
+
+  bool operator==(const LightChunkHash &other) const {
+    return lo == other.lo && hi == other.hi;
+  }
+
+  bool operator!=(const LightChunkHash &other) const {
+    return !(*this == other);
+  }
+};
+
+// Hashes data into two independent 64-bit lanes, 16 bytes at a time. This is
+// not a cryptographic hash; it only needs to make accidental collisions between
+// chunk contents vanishingly unlikely while keeping up with memory bandwidth.
+class LightChunkHasher {
+public:
+  void update(const void *data, size_t size) {
+    auto bytes = static_cast<const uint8_t *>(data);
+    for (; size >= 16; bytes += 16, size -= 16) {
+      uint64_t words[2];
+      std::memcpy(words, bytes, 16);
+      mix(words[0], words[1]);
+    }
+    if (size) {
+      uint64_t words[2] = {0, 0};
+      std::memcpy(words, bytes, size);
+      mix(words[0] ^ size, words[1]);
+    }
+  }
+
+  template <typename T>
+  void update(const T &value) {
+    update(&value, sizeof(value));
+  }
+
+  auto digest() const {
+    auto a = a_ + length_, b = b_ ^ length_;
+    a += b;
+    b += a;
+    return LightChunkHash{fmix(a), fmix(b)};
+  }
+
+private:
+  static constexpr uint64_t kPrime1 = 0x9e3779b185ebca87ull;
+  static constexpr uint64_t kPrime2 = 0xc2b2ae3d27d4eb4full;
+
+  static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+  // The murmur3 finalizer.
+  static uint64_t fmix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+  }
+
+  void mix(uint64_t w0, uint64_t w1) {
+    a_ = rotl(a_ ^ (w0 * kPrime1), 31) * kPrime2;
+    b_ = rotl(b_ ^ (w1 * kPrime2), 29) * kPrime1;
+    a_ += b_;
+    length_ += 16;
+  }
+
+  uint64_t a_ = 0x243f6a8885a308d3ull;
+  uint64_t b_ = 0x13198a2e03707344ull;
+  uint64_t length_ = 0;
+};
+
+// Hashes everything a batch relight into out_layout depends on: the shape,
+// the layouts, and both input volumes including the halo. Only the slots of
+// positions within the padded shape are read, so the slots that brick and
+// Morton layouts round the volumes up with may hold anything.
+inline auto hash_light_chunk(const LightChunk &chunk, LightLayout out_layout) {
+  LightChunkHasher hasher;
+  hasher.update(chunk.shape.x);
+  hasher.update(chunk.shape.y);
+  hasher.update(chunk.shape.z);
+  hasher.update(static_cast<uint32_t>(chunk.layout));
+  hasher.update(static_cast<uint32_t>(out_layout));
+
+  // Storage order visits the slots in increasing order, so they are hashed a
+  // run of adjacent slots at a time.
+  size_t begin = 0, end = 0;
+  auto flush = [&] {
+    hasher.update(chunk.occupancy + begin, end - begin);
+    hasher.update(chunk.samples + begin, (end - begin) * sizeof(Vec3f));
+  };
+  auto shape = padded_shape(chunk);
+  dispatch_layout(chunk.layout, [&](auto kLayout) {
+    traverse_layout(kLayout, shape, [&](Vec3u pos) {
+      auto index = layout_index<kLayout>(shape, pos);
+      if (index != end) {
+        flush();
+        begin = index;
+      }
+      end = index + 1;
+    });
+  });
+  flush();
+  return hasher.digest();
+}
+
+struct LightCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0; // Bytes of light masks currently held.
+};
+
+// Caches the output of apply_light_kernel_batch by the content of its inputs,
+// so relighting a chunk seen before, such as a reloaded chunk or a stamped
+// prefab, is a lookup. Holds at most capacity bytes of light masks, evicting
+// the least recently used results first. All methods are thread-safe. Results
+// are shared and immutable, so they stay valid after being evicted.
+template <typename LightMask>
+class LightCache {
+public:
+  using Result = std::shared_ptr<const std::vector<LightMask>>;
+
+  explicit LightCache(size_t capacity) : capacity_(capacity) {}
+
+  // Returns the light masks of the chunk in out_layout, lighting it on a miss.
+  // Concurrent misses on the same inputs may each light the chunk; the first
+  // result inserted is kept and returned to all of them.
+  auto light(const LightChunk &chunk,
+             LightLayout out_layout = LightLayout::kLinear) {
+    auto key = hash_light_chunk(chunk, out_layout);
+    if (auto result = find(key)) {
+      return result;
+    }
+
+    auto masks = std::make_shared<std::vector<LightMask>>(
+        layout_size(out_layout, chunk.shape));
+    apply_light_kernel_batch(chunk, masks->data(), out_layout);
+    return insert(key, std::move(masks));
+  }
+
+  // Returns the cached result for key, or null if there is none.
+  Result find(const LightChunkHash &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      stats_.misses += 1;
+      return nullptr;
+    }
+    stats_.hits += 1;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->result;
+  }
+
+  // Caches result under key, unless key is already cached, and returns the
+  // cached result. A result larger than the whole cache is returned uncached.
+  Result insert(const LightChunkHash &key, Result result) {
+    auto bytes = result->size() * sizeof(LightMask);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = index_.find(key); it != index_.end()) {
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return it->second->result;
+    }
+    if (bytes > capacity_) {
+      return result;
+    }
+
+    while (stats_.bytes + bytes > capacity_) {
+      auto &last = entries_.back();
+      stats_.bytes -= last.bytes;
+      stats_.evictions += 1;
+      index_.erase(last.key);
+      entries_.pop_back();
+    }
+    entries_.push_front({key, result, bytes});
+    index_.emplace(key, entries_.begin());
+    stats_.bytes += bytes;
+    return result;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    entries_.clear();
+    stats_.bytes = 0;
+  }
+
+  auto stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stats = stats_;
+    stats.entries = entries_.size();
+    return stats;
+  }
+
+  auto capacity() const { return capacity_; }
+
+private:
+  struct Entry {
+    LightChunkHash key;
+    Result result;
+    size_t bytes;
+  };
+
+  struct KeyHash {
+    size_t operator()(const LightChunkHash &key) const {
+      return static_cast<size_t>(key.lo);
+    }
+  };
+
+  using EntryList = std::list<Entry>;
+
+  size_t capacity_;
+  mutable std::mutex mutex_;
+  EntryList entries_;
+  std::unordered_map<LightChunkHash, typename EntryList::iterator, KeyHash>
+      index_;
+  LightCacheStats stats_;
+};
+
+} // namespace voxeloo::galois::lighting
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+#include <VoxelooGeometry/geometry.hpp>
+#include <VoxelooLightKernelry/light_layout.hpp>
+
+namespace voxeloo::galois::lighting {
+
+// The inputs of a chunk relight. Both volumes are padded with a one voxel halo
+// on every side, so they hold shape + 2 voxels per axis in the given layout and
+// chunk voxel (0, 0, 0) is stored at (1, 1, 1).
+struct LightChunk {
+  Vec3u shape;
+  LightLayout layout = LightLayout::kLinear;
+  const Vec3f *samples = nullptr;     // Light value of each voxel.
+  const uint8_t *occupancy = nullptr; // Nonzero where a voxel blocks light.
+};
+
+inline auto padded_shape(const LightChunk &chunk) {
+  return Vec3u{chunk.shape.x + 2, chunk.shape.y + 2, chunk.shape.z + 2};
+}
+
+} // namespace voxeloo::galois::lighting
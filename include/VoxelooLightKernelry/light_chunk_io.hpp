@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <VoxelooGeometry/geometry.hpp>
+#include <VoxelooLightKernelry/light_chunk.hpp>
+#include <VoxelooLightKernelry/light_delta.hpp>
+#include <VoxelooLightKernelry/light_layout.hpp>
+#include <VoxelooLightKernelry/light_mask.hpp>
+
+namespace voxeloo::galois::lighting {
+
+// A recorded chunk holding the inputs the kernel sees, including the halo.
+// Volumes are stored in the linear layout.
+struct LightChunkData {
+  Vec3i origin = {0, 0, 0}; // World position of chunk voxel (0, 0, 0).
+  Vec3u shape = {0, 0, 0};
+  std::vector<Vec3f> samples;
+  std::vector<uint8_t> occupancy;
+
+  auto chunk() const {
+    return LightChunk{shape, LightLayout::kLinear, samples.data(),
+                      occupancy.data()};
+  }
+};
+
+// Chunk records are laid out as follows, in host byte order (little-endian on
+// every platform we ship):
+//
+//   char[4]   magic "VLKC"
+//   uint32    version
+//   int32[3]  origin
+//   uint32[3] shape
+//   uint8[n]  occupancy, n = (shape.x + 2) * (shape.y + 2) * (shape.z + 2)
+//   float[3n] samples
+//
+// A corpus is any number of records written back to back.
+static constexpr std::array<char, 4> kLightChunkMagic = {'V', 'L', 'K', 'C'};
+static constexpr uint32_t kLightChunkVersion = 1;
+
+static_assert(sizeof(Vec3f) == 3 * sizeof(float));
+
+static constexpr uint32_t kMaxLightChunkSide = 1024;
+
+template <typename Vec>
+inline void write_light_chunk_field(std::ostream &out, const Vec &value) {
+  for (auto v : {value.x, value.y, value.z}) {
+    out.write(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+}
+
+template <typename Vec>
+inline bool read_light_chunk_field(std::istream &in, Vec &value) {
+  for (auto *v : {&value.x, &value.y, &value.z}) {
+    in.read(reinterpret_cast<char *>(v), sizeof(*v));
+  }
+  return bool(in);
+}
+
+// Reads count values in bounded slices, growing values as the data arrives, so
+// a corrupt count fails at the end of the stream instead of allocating for it.
+template <typename T>
+inline bool read_light_chunk_values(std::istream &in, std::vector<T> &values,
+                                    size_t count) {
+  static constexpr size_t kSlice = (size_t(1) << 20) / sizeof(T);
+  values.clear();
+  while (values.size() < count) {
+    auto offset = values.size();
+    auto n = std::min(kSlice, count - offset);
+    values.resize(offset + n);
+    if (!in.read(reinterpret_cast<char *>(values.data() + offset),
+                 n * sizeof(T))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline void write_light_chunk(std::ostream &out, const LightChunkData &data) {
+  out.write(kLightChunkMagic.data(), kLightChunkMagic.size());
+  out.write(reinterpret_cast<const char *>(&kLightChunkVersion),
+            sizeof(kLightChunkVersion));
+  write_light_chunk_field(out, data.origin);
+  write_light_chunk_field(out, data.shape);
+  out.write(reinterpret_cast<const char *>(data.occupancy.data()),
+            data.occupancy.size());
+  out.write(reinterpret_cast<const char *>(data.samples.data()),
+            data.samples.size() * sizeof(Vec3f));
+}
+
+// Reads the next chunk record. Returns false at the end of the stream or if the
+// record is malformed.
+inline bool read_light_chunk(std::istream &in, LightChunkData &data) {
+  std::array<char, 4> magic;
+  uint32_t version;
+  if (!in.read(magic.data(), magic.size()) || magic != kLightChunkMagic) {
+    return false;
+  }
+  in.read(reinterpret_cast<char *>(&version), sizeof(version));
+  if (!in || version != kLightChunkVersion) {
+    return false;
+  }
+  if (!read_light_chunk_field(in, data.origin) ||
+      !read_light_chunk_field(in, data.shape)) {
+    return false;
+  }
+  if (std::max({data.shape.x, data.shape.y, data.shape.z}) >
+      kMaxLightChunkSide) {
+    return false;
+  }
+
+  auto size = layout_size(LightLayout::kLinear, padded_shape(data.chunk()));
+  return read_light_chunk_values(in, data.occupancy, size) &&
+         read_light_chunk_values(in, data.samples, size);
+}
+
+inline auto read_light_corpus(std::istream &in) {
+  std::vector<LightChunkData> corpus;
+  LightChunkData data;
+  while (read_light_chunk(in, data)) {
+    corpus.push_back(std::move(data));
+  }
+  return corpus;
+}
+
+// Copies the inputs of a recorded chunk into the given layout.
+inline void relayout_light_chunk(const LightChunkData &data,
+                                 LightLayout layout,
+                                 std::vector<Vec3f> &samples,
+                                 std::vector<uint8_t> &occupancy) {
+  auto shape = padded_shape(data.chunk());
+  samples.assign(layout_size(layout, shape), Vec3f{0.0, 0.0, 0.0});
+  occupancy.assign(layout_size(layout, shape), 1);
+  traverse_layout(LightLayout::kLinear, shape, [&](Vec3u pos) {
+    auto src = layout_index(LightLayout::kLinear, shape, pos);
+    auto dst = layout_index(layout, shape, pos);
+    samples[dst] = data.samples[src];
+    occupancy[dst] = data.occupancy[src];
+  });
+}
+
+// Baked light records hold the light masks of a chunk as a delta from an all
+// dark chunk, so dark voxels, which make up most of the ground, cost nothing:
+//
+//   char[4]   magic "VLKB"
+//   uint32    version
+//   int32[3]  origin
+//   uint32[3] shape
+//   uint32    size of the delta in bytes
+//   uint8[m]  the delta, as by serialize_light_delta
+//
+// Baked chunks are written back to back like a corpus.
+static constexpr std::array<char, 4> kBakedLightMagic = {'V', 'L', 'K', 'B'};
+static constexpr uint32_t kBakedLightVersion = 1;
+
+// Writes a baked record whose delta has already been serialized into buffer.
+inline void write_baked_light_record(std::ostream &out, Vec3i origin,
+                                     Vec3u shape,
+                                     const std::vector<uint8_t> &buffer) {
+  auto size = static_cast<uint32_t>(buffer.size());
+  out.write(kBakedLightMagic.data(), kBakedLightMagic.size());
+  out.write(reinterpret_cast<const char *>(&kBakedLightVersion),
+            sizeof(kBakedLightVersion));
+  write_light_chunk_field(out, origin);
+  write_light_chunk_field(out, shape);
+  out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  out.write(reinterpret_cast<const char *>(buffer.data()), size);
+}
+
+// Writes the light masks of a chunk, given as the entries of a delta against an
+// all dark chunk, such as the one filled by lighting into zeroed masks.
+inline void write_baked_light_chunk(std::ostream &out, Vec3i origin,
+                                    Vec3u shape,
+                                    const std::vector<LightDeltaEntry> &entries,
+                                    std::vector<uint8_t> &buffer) {
+  buffer.clear();
+  serialize_light_delta(entries, buffer);
+  write_baked_light_record(out, origin, shape, buffer);
+}
+
+// Writes the light masks of a chunk, stored in the linear layout.
+inline void write_baked_light_chunk(std::ostream &out, Vec3i origin,
+                                    Vec3u shape, const PackedLightMask *masks,
+                                    std::vector<uint8_t> &buffer) {
+  buffer.clear();
+  serialize_light_masks(masks, layout_size(LightLayout::kLinear, shape),
+                        buffer);
+  write_baked_light_record(out, origin, shape, buffer);
+}
+
+// Reads the next baked record into masks, stored in the given layout. Returns
+// false at the end of the stream or if the record is malformed.
+inline bool read_baked_light_chunk(std::istream &in, Vec3i &origin,
+                                   Vec3u &shape, LightLayout layout,
+                                   std::vector<PackedLightMask> &masks) {
+  std::array<char, 4> magic;
+  uint32_t version, size;
+  if (!in.read(magic.data(), magic.size()) || magic != kBakedLightMagic) {
+    return false;
+  }
+  in.read(reinterpret_cast<char *>(&version), sizeof(version));
+  if (!in || version != kBakedLightVersion) {
+    return false;
+  }
+  if (!read_light_chunk_field(in, origin) ||
+      !read_light_chunk_field(in, shape) ||
+      !in.read(reinterpret_cast<char *>(&size), sizeof(size))) {
+    return false;
+  }
+  if (std::max({shape.x, shape.y, shape.z}) > kMaxLightChunkSide) {
+    return false;
+  }
+
+  std::vector<uint8_t> buffer;
+  std::vector<LightDeltaEntry> entries;
+  auto count = layout_size(LightLayout::kLinear, shape);
+  if (!read_light_chunk_values(in, buffer, size) ||
+      !deserialize_light_delta(buffer.data(), size, count, entries)) {
+    return false;
+  }
+  masks.assign(layout_size(layout, shape), PackedLightMask{});
+  apply_light_delta(entries, shape, layout, masks.data());
+  return true;
+}
+
+} // namespace voxeloo::galois::lighting
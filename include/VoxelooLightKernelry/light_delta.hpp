@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <VoxelooGeometry/geometry.hpp>
+#include <VoxelooLightKernelry/light_layout.hpp>
+#include <VoxelooLightKernelry/light_mask.hpp>
+
+namespace voxeloo::galois::lighting {
+
+// A voxel whose light mask changed in a relight. Bit i of corners is set if
+// corner i, at {i & 1, (i >> 1) & 1, i >> 2}, changed, in which case values[i]
+// holds its new value packed as by PackedLightMask::pack.
+struct LightDeltaEntry {
+  uint32_t voxel; // Linear index of the voxel within the chunk.
+  uint8_t corners;
+  std::array<uint16_t, 8> values;
+};
+
+// Collects the corners a batch relight changed, as a compact alternative to
+// diffing or resending the whole chunk. Only light is recorded, so the batch
+// API rejects deltas for occlusion masks, whose component sizes would be lost.
+class LightDelta {
+public:
+  void clear() {
+    changes_.clear();
+    entries_.clear();
+  }
+
+  void record(uint32_t voxel, uint32_t corner, uint16_t value) {
+    changes_.push_back({voxel, corner, value});
+  }
+
+  // Merges the recorded changes into one entry per voxel, ordered by voxel.
+  void finish() {
+    std::sort(changes_.begin(), changes_.end(),
+              [](const auto &a, const auto &b) { return a.voxel < b.voxel; });
+    for (const auto &change : changes_) {
+      if (entries_.empty() || entries_.back().voxel != change.voxel) {
+        entries_.push_back({change.voxel, 0, {}});
+      }
+      entries_.back().corners |= 1 << change.corner;
+      entries_.back().values[change.corner] = change.value;
+    }
+    changes_.clear();
+  }
+
+  const auto &entries() const { return entries_; }
+
+private:
+  struct Change {
+    uint32_t voxel;
+    uint32_t corner;
+    uint16_t value;
+  };
+
+  std::vector<Change> changes_;
+  std::vector<LightDeltaEntry> entries_;
+};
+
+// Entries are serialized as the varint gap to the previous entry's voxel (or
+// to 0 for the first), the corner bits, and then the 12-bit value of each
+// changed corner, packed in pairs into three bytes with an odd last value
+// taking two. The stream starts with the varint entry count.
+inline void write_varint(std::vector<uint8_t> &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+inline bool read_varint(const uint8_t *&data, const uint8_t *end,
+                        uint32_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (data == end) {
+      return false;
+    }
+    auto byte = *data++;
+    if (shift == 28 && byte > 0x0f) {
+      return false; // Over 32 bits.
+    }
+    value |= uint32_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void write_light_delta_entry(std::vector<uint8_t> &out, uint32_t gap,
+                                    uint8_t corners,
+                                    const std::array<uint16_t, 8> &values) {
+  write_varint(out, gap);
+  out.push_back(corners);
+
+  uint32_t bits = 0, count = 0;
+  for (int i = 0; i < 8; i += 1) {
+    if (corners & (1 << i)) {
+      bits |= uint32_t(values[i] & 0xfff) << (12 * count);
+      if (++count == 2) {
+        out.insert(out.end(),
+                   {uint8_t(bits), uint8_t(bits >> 8), uint8_t(bits >> 16)});
+        bits = count = 0;
+      }
+    }
+  }
+  if (count) {
+    out.insert(out.end(), {uint8_t(bits), uint8_t(bits >> 8)});
+  }
+}
+
+inline void serialize_light_delta(const std::vector<LightDeltaEntry> &entries,
+                                  std::vector<uint8_t> &out) {
+  write_varint(out, static_cast<uint32_t>(entries.size()));
+  uint32_t prev = 0;
+  for (const auto &entry : entries) {
+    write_light_delta_entry(out, entry.voxel - prev, entry.corners,
+                            entry.values);
+    prev = entry.voxel;
+  }
+}
+
+// Serializes count light masks in the linear layout as a delta from all dark
+// masks, with one entry for each voxel that has a lit corner. This gives the
+// same bytes as serializing the delta of lighting into zeroed masks, without
+// collecting that delta.
+inline void serialize_light_masks(const PackedLightMask *masks, size_t count,
+                                  std::vector<uint8_t> &out) {
+  uint32_t entries = 0;
+  for (size_t voxel = 0; voxel < count; voxel += 1) {
+    entries += masks[voxel] != PackedLightMask{};
+  }
+  write_varint(out, entries);
+
+  uint32_t prev = 0;
+  for (uint32_t voxel = 0; voxel < count; voxel += 1) {
+    uint8_t corners = 0;
+    std::array<uint16_t, 8> values;
+    for (int i = 0; i < 8; i += 1) {
+      values[i] = masks[voxel].corner(i);
+      corners |= (values[i] != 0) << i;
+    }
+    if (corners) {
+      write_light_delta_entry(out, voxel - prev, corners, values);
+      prev = voxel;
+    }
+  }
+}
+
+// Parses a serialized delta for a chunk of the given number of voxels.
+// Returns false if the data is truncated or an entry is out of range.
+inline bool deserialize_light_delta(const uint8_t *data, size_t size,
+                                    size_t voxels,
+                                    std::vector<LightDeltaEntry> &entries) {
+  auto end = data + size;
+  uint32_t count;
+  if (!read_varint(data, end, count)) {
+    return false;
+  }
+
+  entries.clear();
+  uint32_t prev = 0;
+  for (uint32_t n = 0; n < count; n += 1) {
+    LightDeltaEntry entry{0, 0, {}};
+    uint32_t gap;
+    if (!read_varint(data, end, gap) || data == end ||
+        gap >= voxels - prev) {
+      return false;
+    }
+    entry.voxel = prev + gap;
+    entry.corners = *data++;
+    prev = entry.voxel;
+
+    // Values are read in pairs, except for a trailing odd one.
+    uint32_t remaining = 0, pending = 0, bits = 0;
+    for (int i = 0; i < 8; i += 1) {
+      remaining += (entry.corners >> i) & 1;
+    }
+    for (int i = 0; i < 8; i += 1) {
+      if (!(entry.corners & (1 << i))) {
+        continue;
+      }
+      if (pending == 0) {
+        pending = std::min(remaining, 2u);
+        if (end - data < ptrdiff_t(pending + 1)) {
+          return false;
+        }
+        bits = data[0] | data[1] << 8 | (pending == 2 ? data[2] << 16 : 0);
+        data += pending + 1;
+      }
+      entry.values[i] = bits & 0xfff;
+      bits >>= 12;
+      pending -= 1;
+      remaining -= 1;
+    }
+    entries.push_back(entry);
+  }
+  return true;
+}
+
+// Applies delta entries to the light masks of a chunk stored in the given
+// layout. Entries must index voxels within shape, as those returned by
+// deserialize_light_delta for the chunk do.
+inline void apply_light_delta(const std::vector<LightDeltaEntry> &entries,
+                              Vec3u shape, LightLayout layout,
+                              PackedLightMask *out) {
+  for (const auto &entry : entries) {
+    Vec3u pos{entry.voxel % shape.x, (entry.voxel / shape.x) % shape.y,
+              entry.voxel / (shape.x * shape.y)};
+    auto &mask = out[layout_index(layout, shape, pos)];
+    for (uint32_t i = 0; i < 8; i += 1) {
+      if (entry.corners & (1 << i)) {
+        mask.set({i & 1, (i >> 1) & 1, i >> 2},
+                 PackedLightMask::unpack(entry.values[i]));
+      }
+    }
+  }
+}
+
+} // namespace voxeloo::galois::lighting
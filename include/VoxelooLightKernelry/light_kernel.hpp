@@ -2,7 +2,10 @@
 
 #include <algorithm>
 #include <array>
-#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
 
 #include <VoxelooGeometry/geometry.hpp>
 
@@ -25,11 +28,365 @@ static const std::array<int, 256> kMaskToGroupLut = {
     20, 12, 18, 15, 20, 15, 20, 20, 21,
 };
 
+// The open components of each occlusion mask as corner masks, where bit i
+// selects corner i. Unused entries are 0.
+static constexpr std::array<std::array<uint8_t, 4>, 256> kComponentLut = {{
+    {0x00, 0x00, 0x00, 0x00},
+    {0x80, 0x00, 0x00, 0x00},
+    {0x40, 0x00, 0x00, 0x00},
+    {0xc0, 0x00, 0x00, 0x00},
+    {0x20, 0x00, 0x00, 0x00},
+    {0xa0, 0x00, 0x00, 0x00},
+    {0x20, 0x40, 0x00, 0x00},
+    {0xe0, 0x00, 0x00, 0x00},
+    {0x10, 0x00, 0x00, 0x00},
+    {0x10, 0x80, 0x00, 0x00},
+    {0x50, 0x00, 0x00, 0x00},
+    {0xd0, 0x00, 0x00, 0x00},
+    {0x30, 0x00, 0x00, 0x00},
+    {0xb0, 0x00, 0x00, 0x00},
+    {0x70, 0x00, 0x00, 0x00},
+    {0xf0, 0x00, 0x00, 0x00},
+    {0x08, 0x00, 0x00, 0x00},
+    {0x88, 0x00, 0x00, 0x00},
+    {0x08, 0x40, 0x00, 0x00},
+    {0xc8, 0x00, 0x00, 0x00},
+    {0x08, 0x20, 0x00, 0x00},
+    {0xa8, 0x00, 0x00, 0x00},
+    {0x08, 0x20, 0x40, 0x00},
+    {0xe8, 0x00, 0x00, 0x00},
+    {0x08, 0x10, 0x00, 0x00},
+    {0x88, 0x10, 0x00, 0x00},
+    {0x08, 0x50, 0x00, 0x00},
+    {0xd8, 0x00, 0x00, 0x00},
+    {0x08, 0x30, 0x00, 0x00},
+    {0xb8, 0x00, 0x00, 0x00},
+    {0x08, 0x70, 0x00, 0x00},
+    {0xf8, 0x00, 0x00, 0x00},
+    {0x04, 0x00, 0x00, 0x00},
+    {0x04, 0x80, 0x00, 0x00},
+    {0x44, 0x00, 0x00, 0x00},
+    {0xc4, 0x00, 0x00, 0x00},
+    {0x04, 0x20, 0x00, 0x00},
+    {0x04, 0xa0, 0x00, 0x00},
+    {0x44, 0x20, 0x00, 0x00},
+    {0xe4, 0x00, 0x00, 0x00},
+    {0x04, 0x10, 0x00, 0x00},
+    {0x04, 0x10, 0x80, 0x00},
+    {0x54, 0x00, 0x00, 0x00},
+    {0xd4, 0x00, 0x00, 0x00},
+    {0x04, 0x30, 0x00, 0x00},
+    {0x04, 0xb0, 0x00, 0x00},
+    {0x74, 0x00, 0x00, 0x00},
+    {0xf4, 0x00, 0x00, 0x00},
+    {0x0c, 0x00, 0x00, 0x00},
+    {0x8c, 0x00, 0x00, 0x00},
+    {0x4c, 0x00, 0x00, 0x00},
+    {0xcc, 0x00, 0x00, 0x00},
+    {0x0c, 0x20, 0x00, 0x00},
+    {0xac, 0x00, 0x00, 0x00},
+    {0x4c, 0x20, 0x00, 0x00},
+    {0xec, 0x00, 0x00, 0x00},
+    {0x0c, 0x10, 0x00, 0x00},
+    {0x8c, 0x10, 0x00, 0x00},
+    {0x5c, 0x00, 0x00, 0x00},
+    {0xdc, 0x00, 0x00, 0x00},
+    {0x0c, 0x30, 0x00, 0x00},
+    {0xbc, 0x00, 0x00, 0x00},
+    {0x7c, 0x00, 0x00, 0x00},
+    {0xfc, 0x00, 0x00, 0x00},
+    {0x02, 0x00, 0x00, 0x00},
+    {0x02, 0x80, 0x00, 0x00},
+    {0x02, 0x40, 0x00, 0x00},
+    {0x02, 0xc0, 0x00, 0x00},
+    {0x22, 0x00, 0x00, 0x00},
+    {0xa2, 0x00, 0x00, 0x00},
+    {0x22, 0x40, 0x00, 0x00},
+    {0xe2, 0x00, 0x00, 0x00},
+    {0x02, 0x10, 0x00, 0x00},
+    {0x02, 0x10, 0x80, 0x00},
+    {0x02, 0x50, 0x00, 0x00},
+    {0x02, 0xd0, 0x00, 0x00},
+    {0x32, 0x00, 0x00, 0x00},
+    {0xb2, 0x00, 0x00, 0x00},
+    {0x72, 0x00, 0x00, 0x00},
+    {0xf2, 0x00, 0x00, 0x00},
+    {0x0a, 0x00, 0x00, 0x00},
+    {0x8a, 0x00, 0x00, 0x00},
+    {0x0a, 0x40, 0x00, 0x00},
+    {0xca, 0x00, 0x00, 0x00},
+    {0x2a, 0x00, 0x00, 0x00},
+    {0xaa, 0x00, 0x00, 0x00},
+    {0x2a, 0x40, 0x00, 0x00},
+    {0xea, 0x00, 0x00, 0x00},
+    {0x0a, 0x10, 0x00, 0x00},
+    {0x8a, 0x10, 0x00, 0x00},
+    {0x0a, 0x50, 0x00, 0x00},
+    {0xda, 0x00, 0x00, 0x00},
+    {0x3a, 0x00, 0x00, 0x00},
+    {0xba, 0x00, 0x00, 0x00},
+    {0x7a, 0x00, 0x00, 0x00},
+    {0xfa, 0x00, 0x00, 0x00},
+    {0x02, 0x04, 0x00, 0x00},
+    {0x02, 0x04, 0x80, 0x00},
+    {0x02, 0x44, 0x00, 0x00},
+    {0x02, 0xc4, 0x00, 0x00},
+    {0x22, 0x04, 0x00, 0x00},
+    {0xa2, 0x04, 0x00, 0x00},
+    {0x22, 0x44, 0x00, 0x00},
+    {0xe6, 0x00, 0x00, 0x00},
+    {0x02, 0x04, 0x10, 0x00},
+    {0x02, 0x04, 0x10, 0x80},
+    {0x02, 0x54, 0x00, 0x00},
+    {0x02, 0xd4, 0x00, 0x00},
+    {0x32, 0x04, 0x00, 0x00},
+    {0xb2, 0x04, 0x00, 0x00},
+    {0x76, 0x00, 0x00, 0x00},
+    {0xf6, 0x00, 0x00, 0x00},
+    {0x0e, 0x00, 0x00, 0x00},
+    {0x8e, 0x00, 0x00, 0x00},
+    {0x4e, 0x00, 0x00, 0x00},
+    {0xce, 0x00, 0x00, 0x00},
+    {0x2e, 0x00, 0x00, 0x00},
+    {0xae, 0x00, 0x00, 0x00},
+    {0x6e, 0x00, 0x00, 0x00},
+    {0xee, 0x00, 0x00, 0x00},
+    {0x0e, 0x10, 0x00, 0x00},
+    {0x8e, 0x10, 0x00, 0x00},
+    {0x5e, 0x00, 0x00, 0x00},
+    {0xde, 0x00, 0x00, 0x00},
+    {0x3e, 0x00, 0x00, 0x00},
+    {0xbe, 0x00, 0x00, 0x00},
+    {0x7e, 0x00, 0x00, 0x00},
+    {0xfe, 0x00, 0x00, 0x00},
+    {0x01, 0x00, 0x00, 0x00},
+    {0x01, 0x80, 0x00, 0x00},
+    {0x01, 0x40, 0x00, 0x00},
+    {0x01, 0xc0, 0x00, 0x00},
+    {0x01, 0x20, 0x00, 0x00},
+    {0x01, 0xa0, 0x00, 0x00},
+    {0x01, 0x20, 0x40, 0x00},
+    {0x01, 0xe0, 0x00, 0x00},
+    {0x11, 0x00, 0x00, 0x00},
+    {0x11, 0x80, 0x00, 0x00},
+    {0x51, 0x00, 0x00, 0x00},
+    {0xd1, 0x00, 0x00, 0x00},
+    {0x31, 0x00, 0x00, 0x00},
+    {0xb1, 0x00, 0x00, 0x00},
+    {0x71, 0x00, 0x00, 0x00},
+    {0xf1, 0x00, 0x00, 0x00},
+    {0x01, 0x08, 0x00, 0x00},
+    {0x01, 0x88, 0x00, 0x00},
+    {0x01, 0x08, 0x40, 0x00},
+    {0x01, 0xc8, 0x00, 0x00},
+    {0x01, 0x08, 0x20, 0x00},
+    {0x01, 0xa8, 0x00, 0x00},
+    {0x01, 0x08, 0x20, 0x40},
+    {0x01, 0xe8, 0x00, 0x00},
+    {0x11, 0x08, 0x00, 0x00},
+    {0x11, 0x88, 0x00, 0x00},
+    {0x51, 0x08, 0x00, 0x00},
+    {0xd9, 0x00, 0x00, 0x00},
+    {0x31, 0x08, 0x00, 0x00},
+    {0xb9, 0x00, 0x00, 0x00},
+    {0x71, 0x08, 0x00, 0x00},
+    {0xf9, 0x00, 0x00, 0x00},
+    {0x05, 0x00, 0x00, 0x00},
+    {0x05, 0x80, 0x00, 0x00},
+    {0x45, 0x00, 0x00, 0x00},
+    {0xc5, 0x00, 0x00, 0x00},
+    {0x05, 0x20, 0x00, 0x00},
+    {0x05, 0xa0, 0x00, 0x00},
+    {0x45, 0x20, 0x00, 0x00},
+    {0xe5, 0x00, 0x00, 0x00},
+    {0x15, 0x00, 0x00, 0x00},
+    {0x15, 0x80, 0x00, 0x00},
+    {0x55, 0x00, 0x00, 0x00},
+    {0xd5, 0x00, 0x00, 0x00},
+    {0x35, 0x00, 0x00, 0x00},
+    {0xb5, 0x00, 0x00, 0x00},
+    {0x75, 0x00, 0x00, 0x00},
+    {0xf5, 0x00, 0x00, 0x00},
+    {0x0d, 0x00, 0x00, 0x00},
+    {0x8d, 0x00, 0x00, 0x00},
+    {0x4d, 0x00, 0x00, 0x00},
+    {0xcd, 0x00, 0x00, 0x00},
+    {0x0d, 0x20, 0x00, 0x00},
+    {0xad, 0x00, 0x00, 0x00},
+    {0x4d, 0x20, 0x00, 0x00},
+    {0xed, 0x00, 0x00, 0x00},
+    {0x1d, 0x00, 0x00, 0x00},
+    {0x9d, 0x00, 0x00, 0x00},
+    {0x5d, 0x00, 0x00, 0x00},
+    {0xdd, 0x00, 0x00, 0x00},
+    {0x3d, 0x00, 0x00, 0x00},
+    {0xbd, 0x00, 0x00, 0x00},
+    {0x7d, 0x00, 0x00, 0x00},
+    {0xfd, 0x00, 0x00, 0x00},
+    {0x03, 0x00, 0x00, 0x00},
+    {0x03, 0x80, 0x00, 0x00},
+    {0x03, 0x40, 0x00, 0x00},
+    {0x03, 0xc0, 0x00, 0x00},
+    {0x23, 0x00, 0x00, 0x00},
+    {0xa3, 0x00, 0x00, 0x00},
+    {0x23, 0x40, 0x00, 0x00},
+    {0xe3, 0x00, 0x00, 0x00},
+    {0x13, 0x00, 0x00, 0x00},
+    {0x13, 0x80, 0x00, 0x00},
+    {0x53, 0x00, 0x00, 0x00},
+    {0xd3, 0x00, 0x00, 0x00},
+    {0x33, 0x00, 0x00, 0x00},
+    {0xb3, 0x00, 0x00, 0x00},
+    {0x73, 0x00, 0x00, 0x00},
+    {0xf3, 0x00, 0x00, 0x00},
+    {0x0b, 0x00, 0x00, 0x00},
+    {0x8b, 0x00, 0x00, 0x00},
+    {0x0b, 0x40, 0x00, 0x00},
+    {0xcb, 0x00, 0x00, 0x00},
+    {0x2b, 0x00, 0x00, 0x00},
+    {0xab, 0x00, 0x00, 0x00},
+    {0x2b, 0x40, 0x00, 0x00},
+    {0xeb, 0x00, 0x00, 0x00},
+    {0x1b, 0x00, 0x00, 0x00},
+    {0x9b, 0x00, 0x00, 0x00},
+    {0x5b, 0x00, 0x00, 0x00},
+    {0xdb, 0x00, 0x00, 0x00},
+    {0x3b, 0x00, 0x00, 0x00},
+    {0xbb, 0x00, 0x00, 0x00},
+    {0x7b, 0x00, 0x00, 0x00},
+    {0xfb, 0x00, 0x00, 0x00},
+    {0x07, 0x00, 0x00, 0x00},
+    {0x07, 0x80, 0x00, 0x00},
+    {0x47, 0x00, 0x00, 0x00},
+    {0xc7, 0x00, 0x00, 0x00},
+    {0x27, 0x00, 0x00, 0x00},
+    {0xa7, 0x00, 0x00, 0x00},
+    {0x67, 0x00, 0x00, 0x00},
+    {0xe7, 0x00, 0x00, 0x00},
+    {0x17, 0x00, 0x00, 0x00},
+    {0x17, 0x80, 0x00, 0x00},
+    {0x57, 0x00, 0x00, 0x00},
+    {0xd7, 0x00, 0x00, 0x00},
+    {0x37, 0x00, 0x00, 0x00},
+    {0xb7, 0x00, 0x00, 0x00},
+    {0x77, 0x00, 0x00, 0x00},
+    {0xf7, 0x00, 0x00, 0x00},
+    {0x0f, 0x00, 0x00, 0x00},
+    {0x8f, 0x00, 0x00, 0x00},
+    {0x4f, 0x00, 0x00, 0x00},
+    {0xcf, 0x00, 0x00, 0x00},
+    {0x2f, 0x00, 0x00, 0x00},
+    {0xaf, 0x00, 0x00, 0x00},
+    {0x6f, 0x00, 0x00, 0x00},
+    {0xef, 0x00, 0x00, 0x00},
+    {0x1f, 0x00, 0x00, 0x00},
+    {0x9f, 0x00, 0x00, 0x00},
+    {0x5f, 0x00, 0x00, 0x00},
+    {0xdf, 0x00, 0x00, 0x00},
+    {0x3f, 0x00, 0x00, 0x00},
+    {0xbf, 0x00, 0x00, 0x00},
+    {0x7f, 0x00, 0x00, 0x00},
+    {0xff, 0x00, 0x00, 0x00},
+}};
+
+// Light masks may optionally implement bulk corner writes, which the kernel
+// then uses in place of per-corner set() and get() calls. Corner i is the
+// corner at {i & 1, (i >> 1) & 1, i >> 2}.
+//
+//   out.set_all(value);              // Sets all 8 corners.
+//   out.set_corners(corners, value); // Sets corner i if bit i is set.
+//   out.permute_corners(index);      // Corner i takes corner index[i].
+template <typename LightMask>
+using light_mask_value_t = std::decay_t<
+    decltype(std::declval<const LightMask &>().get({0u, 0u, 0u}))>;
+
+template <typename LightMask, typename = void>
+struct is_bulk_light_mask : std::false_type {};
+
+template <typename LightMask>
+struct is_bulk_light_mask<
+    LightMask,
+    std::void_t<decltype(std::declval<LightMask &>().set_all(
+                    std::declval<light_mask_value_t<LightMask>>())),
+                decltype(std::declval<LightMask &>().set_corners(
+                    uint8_t{}, std::declval<light_mask_value_t<LightMask>>())),
+                decltype(std::declval<LightMask &>().permute_corners(
+                    std::declval<const std::array<uint8_t, 8> &>()))>>
+    : std::true_type {};
+
+template <typename LightMask>
+inline constexpr bool is_bulk_light_mask_v =
+    is_bulk_light_mask<LightMask>::value;
+
+template <typename LightMask, typename Value>
+inline void set_corners(LightMask &out, uint8_t corners, const Value &value) {
+  if constexpr (is_bulk_light_mask_v<LightMask>) {
+    out.set_corners(corners, value);
+  } else {
+    for (uint32_t i = 0; i < 8; i += 1) {
+      if (corners & (1 << i)) {
+        out.set({i & 1, (i >> 1) & 1, i >> 2}, value);
+      }
+    }
+  }
+}
+
+// Light masks may also optionally record, for each corner, the number of
+// corners in the open component it belongs to, from 0 for an occluded corner up
+// to 8. The kernel fills these in from the same decoded components as the
+// light, in the same pass.
+//
+//   out.set_component_size(corners, size); // Sets corner i if bit i is set.
+//   out.component_size(pos);               // Gets the corner at pos.
+template <typename LightMask, typename = void>
+struct is_occlusion_light_mask : std::false_type {};
+
+template <typename LightMask>
+struct is_occlusion_light_mask<
+    LightMask, std::void_t<decltype(std::declval<LightMask &>()
+                                        .set_component_size(uint8_t{},
+                                                            uint32_t{})),
+                           decltype(std::declval<const LightMask &>()
+                                        .component_size({0u, 0u, 0u}))>>
+    : std::true_type {};
+
+template <typename LightMask>
+inline constexpr bool is_occlusion_light_mask_v =
+    is_occlusion_light_mask<LightMask>::value;
+
+constexpr uint32_t count_corners(uint8_t corners) {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < 8; i += 1) {
+    count += (corners >> i) & 1;
+  }
+  return count;
+}
+
+template <typename LightMask>
+inline void set_component_sizes(LightMask &out, uint8_t occlusion_mask) {
+  for (auto corners : kComponentLut[occlusion_mask]) {
+    if (corners) {
+      out.set_component_size(corners, count_corners(corners));
+    }
+  }
+}
+
 inline auto quantize_light_value(Vec3f value) {
   return (15.0f * clamp(value, 0.0f, 1.0f) + Vec3f{0.5, 0.5, 0.5})
       .to<uint32_t>();
 }
 
+// Light masks holding Vec3f values receive the average light of each corner
+// as is, deferring quantization until after the kernel has run.
+template <typename LightMask>
+inline auto encode_light_value(Vec3f value) {
+  if constexpr (std::is_same_v<light_mask_value_t<LightMask>, Vec3f>) {
+    return value;
+  } else {
+    return quantize_light_value(value);
+  }
+}
+
 template <typename LightMask>
 inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
   LightMask out;
@@ -43,10 +400,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b10000000, value);
     }
     break;
   case 2 /* 00000011 */:
@@ -57,11 +414,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11000000, value);
     }
     break;
   case 3 /* 00000110 */:
@@ -71,10 +427,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[5];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 0, 1}, value);
+      set_corners(out, 0b00100000, value);
     }
     // Emit component 1
     {
@@ -82,10 +438,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[6];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 1, 1}, value);
+      set_corners(out, 0b01000000, value);
     }
     break;
   case 4 /* 00000111 */:
@@ -97,12 +453,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11100000, value);
     }
     break;
   case 5 /* 00001111 */:
@@ -115,13 +469,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11110000, value);
     }
     break;
   case 6 /* 00010110 */:
@@ -131,10 +482,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[3];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 1, 0}, value);
+      set_corners(out, 0b00001000, value);
     }
     // Emit component 1
     {
@@ -142,10 +493,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[5];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 0, 1}, value);
+      set_corners(out, 0b00100000, value);
     }
     // Emit component 2
     {
@@ -153,10 +504,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[6];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 1, 1}, value);
+      set_corners(out, 0b01000000, value);
     }
     break;
   case 7 /* 00010111 */:
@@ -169,13 +520,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 1, 0}, value);
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11101000, value);
     }
     break;
   case 8 /* 00011000 */:
@@ -185,10 +533,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[3];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 1, 0}, value);
+      set_corners(out, 0b00001000, value);
     }
     // Emit component 1
     {
@@ -196,10 +544,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[4];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 0, 1}, value);
+      set_corners(out, 0b00010000, value);
     }
     break;
   case 9 /* 00011001 */:
@@ -210,11 +558,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 1, 0}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b10001000, value);
     }
     // Emit component 1
     {
@@ -222,10 +569,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[4];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 0, 1}, value);
+      set_corners(out, 0b00010000, value);
     }
     break;
   case 10 /* 00011011 */:
@@ -238,13 +585,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 1, 0}, value);
-      out.set({0, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11011000, value);
     }
     break;
   case 11 /* 00011110 */:
@@ -254,10 +598,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[3];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 1, 0}, value);
+      set_corners(out, 0b00001000, value);
     }
     // Emit component 1
     {
@@ -267,12 +611,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[6];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
+      set_corners(out, 0b01110000, value);
     }
     break;
   case 12 /* 00011111 */:
@@ -286,14 +628,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 1, 0}, value);
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11111000, value);
     }
     break;
   case 13 /* 00111100 */:
@@ -304,11 +642,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[3];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 1, 0}, value);
-      out.set({1, 1, 0}, value);
+      set_corners(out, 0b00001100, value);
     }
     // Emit component 1
     {
@@ -317,11 +654,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[5];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
+      set_corners(out, 0b00110000, value);
     }
     break;
   case 14 /* 00111101 */:
@@ -335,14 +671,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 1, 0}, value);
-      out.set({1, 1, 0}, value);
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b10111100, value);
     }
     break;
   case 15 /* 00111111 */:
@@ -357,15 +689,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 1, 0}, value);
-      out.set({1, 1, 0}, value);
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11111100, value);
     }
     break;
   case 16 /* 01101001 */:
@@ -375,10 +702,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[1];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 0, 0}, value);
+      set_corners(out, 0b00000010, value);
     }
     // Emit component 1
     {
@@ -386,10 +713,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[2];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 1, 0}, value);
+      set_corners(out, 0b00000100, value);
     }
     // Emit component 2
     {
@@ -397,10 +724,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[4];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 0, 1}, value);
+      set_corners(out, 0b00010000, value);
     }
     // Emit component 3
     {
@@ -408,10 +735,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b10000000, value);
     }
     break;
   case 17 /* 01101011 */:
@@ -421,10 +748,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[1];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 0, 0}, value);
+      set_corners(out, 0b00000010, value);
     }
     // Emit component 1
     {
@@ -435,13 +762,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 1, 0}, value);
-      out.set({0, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11010100, value);
     }
     break;
   case 18 /* 01101111 */:
@@ -456,15 +780,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 0, 0}, value);
-      out.set({0, 1, 0}, value);
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11110110, value);
     }
     break;
   case 19 /* 01111110 */:
@@ -479,15 +798,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[6];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 0, 0}, value);
-      out.set({0, 1, 0}, value);
-      out.set({1, 1, 0}, value);
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
+      set_corners(out, 0b01111110, value);
     }
     break;
   case 20 /* 01111111 */:
@@ -503,16 +817,10 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({1, 0, 0}, value);
-      out.set({0, 1, 0}, value);
-      out.set({1, 1, 0}, value);
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11111110, value);
     }
     break;
   case 21 /* 11111111 */:
@@ -529,22 +837,14 @@ inline auto group_mask(const std::array<Vec3f, 8> &samples, int group) {
       sum += samples[7];
 
       // Quantize the vertex light value.
-      auto value = quantize_light_value(sum / 8.0f);
+      auto value = encode_light_value<LightMask>(sum / 8.0f);
 
       // Emit the final quantized light value for each corner.
-      out.set({0, 0, 0}, value);
-      out.set({1, 0, 0}, value);
-      out.set({0, 1, 0}, value);
-      out.set({1, 1, 0}, value);
-      out.set({0, 0, 1}, value);
-      out.set({1, 0, 1}, value);
-      out.set({0, 1, 1}, value);
-      out.set({1, 1, 1}, value);
+      set_corners(out, 0b11111111, value);
     }
     break;
   default:
-    std::cout << "Invalid isomorphism group";
-    // CHECK_UNREACHABLE("Invalid isomorphism group");
+    assert(false && "Invalid isomorphism group");
   }
   return out;
 }
@@ -589,8 +889,7 @@ inline auto permute_samples(const std::array<Vec3f, 8> &samples, int permute) {
     out[6] = samples[3];
     break;
   default:
-    std::cout << "Invalid permutation";
-    // CHECK_UNREACHABLE("Invalid permutation");
+    assert(false && "Invalid permutation");
   }
   return out;
 }
@@ -671,8 +970,7 @@ inline auto reflect_samples(const std::array<Vec3f, 8> &samples, int reflect) {
     out[7] = samples[0];
     break;
   default:
-    std::cout << "Invalid reflection";
-    // CHECK_UNREACHABLE("Invalid reflection");
+    assert(false && "Invalid reflection");
   }
   return out;
 }
@@ -712,134 +1010,162 @@ inline auto transform_samples(const std::array<Vec3f, 8> &samples,
   return reflect_samples(permute_samples(samples, permute), reflect);
 }
 
+static constexpr std::array<std::array<uint8_t, 8>, 6> kPermuteCornerLut = {{
+    {0, 1, 2, 3, 4, 5, 6, 7},
+    {0, 2, 1, 3, 4, 6, 5, 7},
+    {0, 1, 4, 5, 2, 3, 6, 7},
+    {0, 4, 1, 5, 2, 6, 3, 7},
+    {0, 2, 4, 6, 1, 3, 5, 7},
+    {0, 4, 2, 6, 1, 5, 3, 7},
+}};
+
 template <typename LightMask>
 inline auto permute_mask(LightMask mask, int permute) {
-  LightMask out = mask;
-  switch (permute) {
-  case 0 /* [0, 1, 2] */:
-    break;
-  case 1 /* [0, 2, 1] */:
-    out.set({1, 0, 0}, mask.get({0, 1, 0}));
-    out.set({0, 1, 0}, mask.get({1, 0, 0}));
-    out.set({1, 0, 1}, mask.get({0, 1, 1}));
-    out.set({0, 1, 1}, mask.get({1, 0, 1}));
-    break;
-  case 2 /* [1, 0, 2] */:
-    out.set({0, 1, 0}, mask.get({0, 0, 1}));
-    out.set({1, 1, 0}, mask.get({1, 0, 1}));
-    out.set({0, 0, 1}, mask.get({0, 1, 0}));
-    out.set({1, 0, 1}, mask.get({1, 1, 0}));
-    break;
-  case 3 /* [1, 2, 0] */:
-    out.set({1, 0, 0}, mask.get({0, 0, 1}));
-    out.set({0, 1, 0}, mask.get({1, 0, 0}));
-    out.set({1, 1, 0}, mask.get({1, 0, 1}));
-    out.set({0, 0, 1}, mask.get({0, 1, 0}));
-    out.set({1, 0, 1}, mask.get({0, 1, 1}));
-    out.set({0, 1, 1}, mask.get({1, 1, 0}));
-    break;
-  case 4 /* [2, 0, 1] */:
-    out.set({1, 0, 0}, mask.get({0, 1, 0}));
-    out.set({0, 1, 0}, mask.get({0, 0, 1}));
-    out.set({1, 1, 0}, mask.get({0, 1, 1}));
-    out.set({0, 0, 1}, mask.get({1, 0, 0}));
-    out.set({1, 0, 1}, mask.get({1, 1, 0}));
-    out.set({0, 1, 1}, mask.get({1, 0, 1}));
-    break;
-  case 5 /* [2, 1, 0] */:
-    out.set({1, 0, 0}, mask.get({0, 0, 1}));
-    out.set({1, 1, 0}, mask.get({0, 1, 1}));
-    out.set({0, 0, 1}, mask.get({1, 0, 0}));
-    out.set({0, 1, 1}, mask.get({1, 1, 0}));
-    break;
-  default:
-    std::cout << "Invalid permutation";
-    // CHECK_UNREACHABLE("Invalid permutation");
+  if constexpr (is_bulk_light_mask_v<LightMask>) {
+    mask.permute_corners(kPermuteCornerLut[permute]);
+    return mask;
+  } else {
+    LightMask out = mask;
+    switch (permute) {
+    case 0 /* [0, 1, 2] */:
+      break;
+    case 1 /* [0, 2, 1] */:
+      out.set({1, 0, 0}, mask.get({0, 1, 0}));
+      out.set({0, 1, 0}, mask.get({1, 0, 0}));
+      out.set({1, 0, 1}, mask.get({0, 1, 1}));
+      out.set({0, 1, 1}, mask.get({1, 0, 1}));
+      break;
+    case 2 /* [1, 0, 2] */:
+      out.set({0, 1, 0}, mask.get({0, 0, 1}));
+      out.set({1, 1, 0}, mask.get({1, 0, 1}));
+      out.set({0, 0, 1}, mask.get({0, 1, 0}));
+      out.set({1, 0, 1}, mask.get({1, 1, 0}));
+      break;
+    case 3 /* [1, 2, 0] */:
+      out.set({1, 0, 0}, mask.get({0, 0, 1}));
+      out.set({0, 1, 0}, mask.get({1, 0, 0}));
+      out.set({1, 1, 0}, mask.get({1, 0, 1}));
+      out.set({0, 0, 1}, mask.get({0, 1, 0}));
+      out.set({1, 0, 1}, mask.get({0, 1, 1}));
+      out.set({0, 1, 1}, mask.get({1, 1, 0}));
+      break;
+    case 4 /* [2, 0, 1] */:
+      out.set({1, 0, 0}, mask.get({0, 1, 0}));
+      out.set({0, 1, 0}, mask.get({0, 0, 1}));
+      out.set({1, 1, 0}, mask.get({0, 1, 1}));
+      out.set({0, 0, 1}, mask.get({1, 0, 0}));
+      out.set({1, 0, 1}, mask.get({1, 1, 0}));
+      out.set({0, 1, 1}, mask.get({1, 0, 1}));
+      break;
+    case 5 /* [2, 1, 0] */:
+      out.set({1, 0, 0}, mask.get({0, 0, 1}));
+      out.set({1, 1, 0}, mask.get({0, 1, 1}));
+      out.set({0, 0, 1}, mask.get({1, 0, 0}));
+      out.set({0, 1, 1}, mask.get({1, 1, 0}));
+      break;
+    default:
+      assert(false && "Invalid permutation");
+    }
+    return out;
   }
-  return out;
 }
 
+static constexpr std::array<std::array<uint8_t, 8>, 8> kReflectCornerLut = {{
+    {0, 1, 2, 3, 4, 5, 6, 7},
+    {4, 5, 6, 7, 0, 1, 2, 3},
+    {2, 3, 0, 1, 6, 7, 4, 5},
+    {6, 7, 4, 5, 2, 3, 0, 1},
+    {1, 0, 3, 2, 5, 4, 7, 6},
+    {5, 4, 7, 6, 1, 0, 3, 2},
+    {3, 2, 1, 0, 7, 6, 5, 4},
+    {7, 6, 5, 4, 3, 2, 1, 0},
+}};
+
 template <typename LightMask>
 inline auto reflect_mask(LightMask mask, int reflect) {
-  LightMask out = mask;
-  switch (reflect) {
-  case 0 /* [0, 0, 0] */:
-    break;
-  case 1 /* [1, 0, 0] */:
-    out.set({0, 0, 0}, mask.get({0, 0, 1}));
-    out.set({1, 0, 0}, mask.get({1, 0, 1}));
-    out.set({0, 1, 0}, mask.get({0, 1, 1}));
-    out.set({1, 1, 0}, mask.get({1, 1, 1}));
-    out.set({0, 0, 1}, mask.get({0, 0, 0}));
-    out.set({1, 0, 1}, mask.get({1, 0, 0}));
-    out.set({0, 1, 1}, mask.get({0, 1, 0}));
-    out.set({1, 1, 1}, mask.get({1, 1, 0}));
-    break;
-  case 2 /* [0, 1, 0] */:
-    out.set({0, 0, 0}, mask.get({0, 1, 0}));
-    out.set({1, 0, 0}, mask.get({1, 1, 0}));
-    out.set({0, 1, 0}, mask.get({0, 0, 0}));
-    out.set({1, 1, 0}, mask.get({1, 0, 0}));
-    out.set({0, 0, 1}, mask.get({0, 1, 1}));
-    out.set({1, 0, 1}, mask.get({1, 1, 1}));
-    out.set({0, 1, 1}, mask.get({0, 0, 1}));
-    out.set({1, 1, 1}, mask.get({1, 0, 1}));
-    break;
-  case 3 /* [1, 1, 0] */:
-    out.set({0, 0, 0}, mask.get({0, 1, 1}));
-    out.set({1, 0, 0}, mask.get({1, 1, 1}));
-    out.set({0, 1, 0}, mask.get({0, 0, 1}));
-    out.set({1, 1, 0}, mask.get({1, 0, 1}));
-    out.set({0, 0, 1}, mask.get({0, 1, 0}));
-    out.set({1, 0, 1}, mask.get({1, 1, 0}));
-    out.set({0, 1, 1}, mask.get({0, 0, 0}));
-    out.set({1, 1, 1}, mask.get({1, 0, 0}));
-    break;
-  case 4 /* [0, 0, 1] */:
-    out.set({0, 0, 0}, mask.get({1, 0, 0}));
-    out.set({1, 0, 0}, mask.get({0, 0, 0}));
-    out.set({0, 1, 0}, mask.get({1, 1, 0}));
-    out.set({1, 1, 0}, mask.get({0, 1, 0}));
-    out.set({0, 0, 1}, mask.get({1, 0, 1}));
-    out.set({1, 0, 1}, mask.get({0, 0, 1}));
-    out.set({0, 1, 1}, mask.get({1, 1, 1}));
-    out.set({1, 1, 1}, mask.get({0, 1, 1}));
-    break;
-  case 5 /* [1, 0, 1] */:
-    out.set({0, 0, 0}, mask.get({1, 0, 1}));
-    out.set({1, 0, 0}, mask.get({0, 0, 1}));
-    out.set({0, 1, 0}, mask.get({1, 1, 1}));
-    out.set({1, 1, 0}, mask.get({0, 1, 1}));
-    out.set({0, 0, 1}, mask.get({1, 0, 0}));
-    out.set({1, 0, 1}, mask.get({0, 0, 0}));
-    out.set({0, 1, 1}, mask.get({1, 1, 0}));
-    out.set({1, 1, 1}, mask.get({0, 1, 0}));
-    break;
-  case 6 /* [0, 1, 1] */:
-    out.set({0, 0, 0}, mask.get({1, 1, 0}));
-    out.set({1, 0, 0}, mask.get({0, 1, 0}));
-    out.set({0, 1, 0}, mask.get({1, 0, 0}));
-    out.set({1, 1, 0}, mask.get({0, 0, 0}));
-    out.set({0, 0, 1}, mask.get({1, 1, 1}));
-    out.set({1, 0, 1}, mask.get({0, 1, 1}));
-    out.set({0, 1, 1}, mask.get({1, 0, 1}));
-    out.set({1, 1, 1}, mask.get({0, 0, 1}));
-    break;
-  case 7 /* [1, 1, 1] */:
-    out.set({0, 0, 0}, mask.get({1, 1, 1}));
-    out.set({1, 0, 0}, mask.get({0, 1, 1}));
-    out.set({0, 1, 0}, mask.get({1, 0, 1}));
-    out.set({1, 1, 0}, mask.get({0, 0, 1}));
-    out.set({0, 0, 1}, mask.get({1, 1, 0}));
-    out.set({1, 0, 1}, mask.get({0, 1, 0}));
-    out.set({0, 1, 1}, mask.get({1, 0, 0}));
-    out.set({1, 1, 1}, mask.get({0, 0, 0}));
-    break;
-  default:
-    std::cout << "Invalid reflection";
-    // CHECK_UNREACHABLE("Invalid reflection");
+  if constexpr (is_bulk_light_mask_v<LightMask>) {
+    mask.permute_corners(kReflectCornerLut[reflect]);
+    return mask;
+  } else {
+    LightMask out = mask;
+    switch (reflect) {
+    case 0 /* [0, 0, 0] */:
+      break;
+    case 1 /* [1, 0, 0] */:
+      out.set({0, 0, 0}, mask.get({0, 0, 1}));
+      out.set({1, 0, 0}, mask.get({1, 0, 1}));
+      out.set({0, 1, 0}, mask.get({0, 1, 1}));
+      out.set({1, 1, 0}, mask.get({1, 1, 1}));
+      out.set({0, 0, 1}, mask.get({0, 0, 0}));
+      out.set({1, 0, 1}, mask.get({1, 0, 0}));
+      out.set({0, 1, 1}, mask.get({0, 1, 0}));
+      out.set({1, 1, 1}, mask.get({1, 1, 0}));
+      break;
+    case 2 /* [0, 1, 0] */:
+      out.set({0, 0, 0}, mask.get({0, 1, 0}));
+      out.set({1, 0, 0}, mask.get({1, 1, 0}));
+      out.set({0, 1, 0}, mask.get({0, 0, 0}));
+      out.set({1, 1, 0}, mask.get({1, 0, 0}));
+      out.set({0, 0, 1}, mask.get({0, 1, 1}));
+      out.set({1, 0, 1}, mask.get({1, 1, 1}));
+      out.set({0, 1, 1}, mask.get({0, 0, 1}));
+      out.set({1, 1, 1}, mask.get({1, 0, 1}));
+      break;
+    case 3 /* [1, 1, 0] */:
+      out.set({0, 0, 0}, mask.get({0, 1, 1}));
+      out.set({1, 0, 0}, mask.get({1, 1, 1}));
+      out.set({0, 1, 0}, mask.get({0, 0, 1}));
+      out.set({1, 1, 0}, mask.get({1, 0, 1}));
+      out.set({0, 0, 1}, mask.get({0, 1, 0}));
+      out.set({1, 0, 1}, mask.get({1, 1, 0}));
+      out.set({0, 1, 1}, mask.get({0, 0, 0}));
+      out.set({1, 1, 1}, mask.get({1, 0, 0}));
+      break;
+    case 4 /* [0, 0, 1] */:
+      out.set({0, 0, 0}, mask.get({1, 0, 0}));
+      out.set({1, 0, 0}, mask.get({0, 0, 0}));
+      out.set({0, 1, 0}, mask.get({1, 1, 0}));
+      out.set({1, 1, 0}, mask.get({0, 1, 0}));
+      out.set({0, 0, 1}, mask.get({1, 0, 1}));
+      out.set({1, 0, 1}, mask.get({0, 0, 1}));
+      out.set({0, 1, 1}, mask.get({1, 1, 1}));
+      out.set({1, 1, 1}, mask.get({0, 1, 1}));
+      break;
+    case 5 /* [1, 0, 1] */:
+      out.set({0, 0, 0}, mask.get({1, 0, 1}));
+      out.set({1, 0, 0}, mask.get({0, 0, 1}));
+      out.set({0, 1, 0}, mask.get({1, 1, 1}));
+      out.set({1, 1, 0}, mask.get({0, 1, 1}));
+      out.set({0, 0, 1}, mask.get({1, 0, 0}));
+      out.set({1, 0, 1}, mask.get({0, 0, 0}));
+      out.set({0, 1, 1}, mask.get({1, 1, 0}));
+      out.set({1, 1, 1}, mask.get({0, 1, 0}));
+      break;
+    case 6 /* [0, 1, 1] */:
+      out.set({0, 0, 0}, mask.get({1, 1, 0}));
+      out.set({1, 0, 0}, mask.get({0, 1, 0}));
+      out.set({0, 1, 0}, mask.get({1, 0, 0}));
+      out.set({1, 1, 0}, mask.get({0, 0, 0}));
+      out.set({0, 0, 1}, mask.get({1, 1, 1}));
+      out.set({1, 0, 1}, mask.get({0, 1, 1}));
+      out.set({0, 1, 1}, mask.get({1, 0, 1}));
+      out.set({1, 1, 1}, mask.get({0, 0, 1}));
+      break;
+    case 7 /* [1, 1, 1] */:
+      out.set({0, 0, 0}, mask.get({1, 1, 1}));
+      out.set({1, 0, 0}, mask.get({0, 1, 1}));
+      out.set({0, 1, 0}, mask.get({1, 0, 1}));
+      out.set({1, 1, 0}, mask.get({0, 0, 1}));
+      out.set({0, 0, 1}, mask.get({1, 1, 0}));
+      out.set({1, 0, 1}, mask.get({0, 1, 0}));
+      out.set({0, 1, 1}, mask.get({1, 0, 0}));
+      out.set({1, 1, 1}, mask.get({0, 0, 0}));
+      break;
+    default:
+      assert(false && "Invalid reflection");
+    }
+    return out;
   }
-  return out;
 }
 
 static const std::array<int, 256> kMaskPermuteLut = {
@@ -889,7 +1215,11 @@ apply_light_kernel_with_occlusion(uint8_t occlusion_mask,
   auto light_mask = group_mask<LightMask>(group_samples, group);
 
   // Transform the light mask to the final output.
-  return transform_mask<LightMask>(light_mask, occlusion_mask);
+  auto out = transform_mask<LightMask>(light_mask, occlusion_mask);
+  if constexpr (is_occlusion_light_mask_v<LightMask>) {
+    set_component_sizes(out, occlusion_mask);
+  }
+  return out;
 }
 
 template <typename LightMask>
@@ -900,17 +1230,24 @@ inline auto apply_light_kernel(const std::array<Vec3f, 8> &samples) {
   }
 
   // Quantize the vertex light value.
-  auto value = quantize_light_value(sum / 8.0f);
+  auto value = encode_light_value<LightMask>(sum / 8.0f);
 
   // Write the output to each corner.
   LightMask out;
-  for (auto dz : {0u, 1u}) {
-    for (auto dy : {0u, 1u}) {
-      for (auto dx : {0u, 1u}) {
-        out.set({dx, dy, dz}, value);
+  if constexpr (is_bulk_light_mask_v<LightMask>) {
+    out.set_all(value);
+  } else {
+    for (auto dz : {0u, 1u}) {
+      for (auto dy : {0u, 1u}) {
+        for (auto dx : {0u, 1u}) {
+          out.set({dx, dy, dz}, value);
+        }
       }
     }
   }
+  if constexpr (is_occlusion_light_mask_v<LightMask>) {
+    out.set_component_size(0xff, 8);
+  }
   return out;
 }
 
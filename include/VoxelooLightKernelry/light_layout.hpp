@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include <VoxelooGeometry/geometry.hpp>
+
+namespace voxeloo::galois::lighting {
+
+// Memory layouts for the voxel volumes consumed and produced by the batch
+// kernel. Tiled layouts round each axis up to whole tiles, which are stored
+// one after another in x-y-z order.
+enum class LightLayout {
+  kLinear, // Plain x-y-z order.
+  kMorton, // 8x8x8 tiles, Z-order curve within tiles.
+  kBrick4, // 4x4x4 bricks, x-y-z order within bricks.
+  kBrick8, // 8x8x8 bricks, x-y-z order within bricks.
+};
+
+// Spreads and compacts the 3 bits of a coordinate within an 8x8x8 Morton tile.
+inline uint32_t morton_tile_spread(uint32_t v) {
+  return (v & 1) | (v & 2) << 2 | (v & 4) << 4;
+}
+
+inline uint32_t morton_tile_compact(uint32_t code) {
+  return (code & 1) | (code >> 2 & 2) | (code >> 4 & 4);
+}
+
+inline auto brick_side(LightLayout layout) {
+  switch (layout) {
+  case LightLayout::kBrick4:
+    return 4u;
+  case LightLayout::kMorton:
+  case LightLayout::kBrick8:
+    return 8u;
+  default:
+    return 1u;
+  }
+}
+
+// Returns the number of elements a volume of the given shape occupies. Tiled
+// layouts round the shape up, so this may exceed the voxel count.
+inline size_t layout_size(LightLayout layout, Vec3u shape) {
+  switch (layout) {
+  case LightLayout::kMorton:
+  case LightLayout::kBrick4:
+  case LightLayout::kBrick8: {
+    size_t b = brick_side(layout);
+    size_t bx = (shape.x + b - 1) / b;
+    size_t by = (shape.y + b - 1) / b;
+    size_t bz = (shape.z + b - 1) / b;
+    return bx * by * bz * b * b * b;
+  }
+  default:
+    return size_t(shape.x) * shape.y * shape.z;
+  }
+}
+
+// Computes the element offsets of positions in a volume of the given shape.
+// The layout is a template argument so that the index math of the hot loops
+// compiles down to shifts and masks. Every layout's offset is a sum of one term
+// per axis, so code visiting a 2x2x2 neighbourhood can add up 6 axis terms
+// rather than compute 8 offsets, and never divides across a tile boundary.
+template <LightLayout kLayout>
+class LightLayoutIndexer {
+public:
+  explicit LightLayoutIndexer(Vec3u shape) {
+    if constexpr (kLayout == LightLayout::kLinear) {
+      strides_ = {1, shape.x, size_t(shape.x) * shape.y};
+    } else {
+      size_t bx = (shape.x + kSide - 1) / kSide;
+      size_t by = (shape.y + kSide - 1) / kSide;
+      strides_ = {kVolume, bx * kVolume, bx * by * kVolume};
+    }
+  }
+
+  // Returns the term of coordinate v on axis kAxis, 0, 1 or 2 for x, y or z.
+  template <int kAxis>
+  size_t axis(uint32_t v) const {
+    if constexpr (kLayout == LightLayout::kLinear) {
+      return v * strides_[kAxis];
+    } else if constexpr (kLayout == LightLayout::kMorton) {
+      return v / kSide * strides_[kAxis] +
+             (size_t(morton_tile_spread(v % kSide)) << kAxis);
+    } else {
+      constexpr size_t kLocalStride = kAxis == 0   ? 1
+                                      : kAxis == 1 ? kSide
+                                                   : kSide * kSide;
+      return v / kSide * strides_[kAxis] + v % kSide * kLocalStride;
+    }
+  }
+
+  size_t operator()(Vec3u pos) const {
+    return axis<0>(pos.x) + axis<1>(pos.y) + axis<2>(pos.z);
+  }
+
+private:
+  static constexpr size_t kSide = kLayout == LightLayout::kBrick4 ? 4 : 8;
+  static constexpr size_t kVolume = kSide * kSide * kSide;
+
+  std::array<size_t, 3> strides_;
+};
+
+// Returns the element offset of the voxel at pos in a volume of the given
+// shape.
+template <LightLayout kLayout>
+inline size_t layout_index(Vec3u shape, Vec3u pos) {
+  return LightLayoutIndexer<kLayout>(shape)(pos);
+}
+
+// Invokes fn with the layout as a std::integral_constant, so it can be passed
+// on as a template argument.
+template <typename Fn>
+inline decltype(auto) dispatch_layout(LightLayout layout, Fn &&fn) {
+  switch (layout) {
+  case LightLayout::kMorton:
+    return fn(std::integral_constant<LightLayout, LightLayout::kMorton>{});
+  case LightLayout::kBrick4:
+    return fn(std::integral_constant<LightLayout, LightLayout::kBrick4>{});
+  case LightLayout::kBrick8:
+    return fn(std::integral_constant<LightLayout, LightLayout::kBrick8>{});
+  default:
+    return fn(std::integral_constant<LightLayout, LightLayout::kLinear>{});
+  }
+}
+
+inline size_t layout_index(LightLayout layout, Vec3u shape, Vec3u pos) {
+  return dispatch_layout(layout, [&](auto kLayout) {
+    return layout_index<kLayout>(shape, pos);
+  });
+}
+
+// Visits the positions of the Morton tile of the given side at origin that lie
+// below end, in Morton order. Octants entirely beyond end are skipped, so a
+// partial tile costs about as many steps as it has positions.
+template <typename Fn>
+inline void traverse_morton_tile(Vec3u origin, uint32_t side, Vec3u end,
+                                 Fn &fn) {
+  if (side == 1) {
+    fn(origin);
+    return;
+  }
+  auto half = side / 2;
+  for (uint32_t i = 0; i < 8; i += 1) {
+    Vec3u corner{origin.x + (i & 1) * half, origin.y + ((i >> 1) & 1) * half,
+                 origin.z + (i >> 2) * half};
+    if (corner.x < end.x && corner.y < end.y && corner.z < end.z) {
+      traverse_morton_tile(corner, half, end, fn);
+    }
+  }
+}
+
+// Invokes fn(pos) for every position within shape, visiting them in the
+// storage order of the given layout so consecutive calls touch neighbouring
+// memory. Every order is monotone: a position is never visited before any
+// position that is less than or equal to it on all three axes.
+template <typename Fn>
+inline void traverse_layout(LightLayout layout, Vec3u shape, Fn &&fn) {
+  auto tile = brick_side(layout);
+  if (tile == 1) {
+    for (uint32_t z = 0; z < shape.z; z += 1) {
+      for (uint32_t y = 0; y < shape.y; y += 1) {
+        for (uint32_t x = 0; x < shape.x; x += 1) {
+          fn(Vec3u{x, y, z});
+        }
+      }
+    }
+    return;
+  }
+
+  for (uint32_t tz = 0; tz < shape.z; tz += tile) {
+    for (uint32_t ty = 0; ty < shape.y; ty += tile) {
+      for (uint32_t tx = 0; tx < shape.x; tx += tile) {
+        auto ex = std::min(tx + tile, shape.x);
+        auto ey = std::min(ty + tile, shape.y);
+        auto ez = std::min(tz + tile, shape.z);
+        if (layout == LightLayout::kMorton) {
+          if (ex - tx < tile || ey - ty < tile || ez - tz < tile) {
+            traverse_morton_tile({tx, ty, tz}, tile, {ex, ey, ez}, fn);
+            continue;
+          }
+          for (uint32_t i = 0; i < tile * tile * tile; i += 1) {
+            fn(Vec3u{tx + morton_tile_compact(i),
+                     ty + morton_tile_compact(i >> 1),
+                     tz + morton_tile_compact(i >> 2)});
+          }
+        } else {
+          for (uint32_t z = tz; z < ez; z += 1) {
+            for (uint32_t y = ty; y < ey; y += 1) {
+              for (uint32_t x = tx; x < ex; x += 1) {
+                fn(Vec3u{x, y, z});
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+} // namespace voxeloo::galois::lighting
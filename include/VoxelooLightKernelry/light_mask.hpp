@@ -0,0 +1,187 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <VoxelooGeometry/geometry.hpp>
+
+namespace voxeloo::galois::lighting {
+
+// A light mask holding the quantized light value of each corner as three 4-bit
+// channels packed into 16 bits. Implements the bulk corner operations, so the
+// kernel writes it without going through set() for each corner.
+class PackedLightMask {
+public:
+  static auto pack(Vec3u value) {
+    return static_cast<uint16_t>(value.x | value.y << 4 | value.z << 8);
+  }
+
+  static auto unpack(uint16_t bits) {
+    return Vec3u{bits & 0xfu, (bits >> 4) & 0xfu, (bits >> 8) & 0xfu};
+  }
+
+  auto get(Vec3u pos) const {
+    return unpack(corners_[pos.x + 2 * (pos.y + 2 * pos.z)]);
+  }
+
+  void set(Vec3u pos, Vec3u value) {
+    corners_[pos.x + 2 * (pos.y + 2 * pos.z)] = pack(value);
+  }
+
+  void set_all(Vec3u value) { corners_.fill(pack(value)); }
+
+  void set_corners(uint8_t corners, Vec3u value) {
+    auto bits = pack(value);
+    for (int i = 0; i < 8; i += 1) {
+      if (corners & (1 << i)) {
+        corners_[i] = bits;
+      }
+    }
+  }
+
+  void permute_corners(const std::array<uint8_t, 8> &index) {
+    auto corners = corners_;
+    for (int i = 0; i < 8; i += 1) {
+      corners_[i] = corners[index[i]];
+    }
+  }
+
+  // The packed value of corner i, at {i & 1, (i >> 1) & 1, i >> 2}.
+  auto corner(int i) const { return corners_[i]; }
+
+  bool operator==(const PackedLightMask &other) const {
+    return corners_ == other.corners_;
+  }
+
+  bool operator!=(const PackedLightMask &other) const {
+    return corners_ != other.corners_;
+  }
+
+private:
+  std::array<uint16_t, 8> corners_ = {};
+};
+
+// Maps the size of the open component of a corner, as recorded by
+// PackedLightOcclusionMask, to an ambient occlusion level from 0, the most
+// occluded, to 3, unoccluded. A corner on flat open ground sees 4 open voxels,
+// so 4 or more is unoccluded.
+static constexpr std::array<uint8_t, 9> kAmbientOcclusionLut = {
+    0, 0, 1, 2, 3, 3, 3, 3, 3};
+
+// A PackedLightMask that also records the size of the open component of each
+// corner in the 4 bits left spare by the light, so the mesher gets ambient
+// occlusion from the lighting pass instead of a second traversal.
+class PackedLightOcclusionMask {
+public:
+  auto get(Vec3u pos) const {
+    return PackedLightMask::unpack(corners_[index(pos)]);
+  }
+
+  void set(Vec3u pos, Vec3u value) {
+    auto &corner = corners_[index(pos)];
+    corner = (corner & kSizeBits) | PackedLightMask::pack(value);
+  }
+
+  void set_all(Vec3u value) {
+    for (auto &corner : corners_) {
+      corner = (corner & kSizeBits) | PackedLightMask::pack(value);
+    }
+  }
+
+  void set_corners(uint8_t corners, Vec3u value) {
+    auto bits = PackedLightMask::pack(value);
+    for (int i = 0; i < 8; i += 1) {
+      if (corners & (1 << i)) {
+        corners_[i] = (corners_[i] & kSizeBits) | bits;
+      }
+    }
+  }
+
+  void permute_corners(const std::array<uint8_t, 8> &index) {
+    auto corners = corners_;
+    for (int i = 0; i < 8; i += 1) {
+      corners_[i] = corners[index[i]];
+    }
+  }
+
+  auto component_size(Vec3u pos) const {
+    return static_cast<uint32_t>(corners_[index(pos)] >> 12);
+  }
+
+  void set_component_size(uint8_t corners, uint32_t size) {
+    for (int i = 0; i < 8; i += 1) {
+      if (corners & (1 << i)) {
+        corners_[i] = static_cast<uint16_t>((corners_[i] & ~kSizeBits) |
+                                            size << 12);
+      }
+    }
+  }
+
+  auto ambient_occlusion(Vec3u pos) const {
+    return kAmbientOcclusionLut[component_size(pos)];
+  }
+
+  // The packed value of corner i, at {i & 1, (i >> 1) & 1, i >> 2}, with the
+  // component size in the top 4 bits.
+  auto corner(int i) const { return corners_[i]; }
+
+  bool operator==(const PackedLightOcclusionMask &other) const {
+    return corners_ == other.corners_;
+  }
+
+  bool operator!=(const PackedLightOcclusionMask &other) const {
+    return corners_ != other.corners_;
+  }
+
+private:
+  static constexpr uint16_t kSizeBits = 0xf000;
+
+  static uint32_t index(Vec3u pos) { return pos.x + 2 * (pos.y + 2 * pos.z); }
+
+  std::array<uint16_t, 8> corners_ = {};
+};
+
+// A light mask holding the unquantized average light of each corner. Lighting
+// into it defers quantization, so a global change such as the sky brightness
+// only needs quantize_light_batch to be rerun rather than the kernel.
+//
+// quantize_light_batch scales each channel as a whole, so this only works if
+// the changing light owns its channels: sky light must be kept apart from
+// block light (e.g. a torch) rather than mixed in with max(sky, block) as the
+// replay bench's terrain does, or dimming the sky dims the torch too. Light
+// that has to share channels needs its own masks, quantized separately.
+class DeferredLightMask {
+public:
+  auto get(Vec3u pos) const {
+    return corners_[pos.x + 2 * (pos.y + 2 * pos.z)];
+  }
+
+  void set(Vec3u pos, Vec3f value) {
+    corners_[pos.x + 2 * (pos.y + 2 * pos.z)] = value;
+  }
+
+  void set_all(Vec3f value) { corners_.fill(value); }
+
+  void set_corners(uint8_t corners, Vec3f value) {
+    for (int i = 0; i < 8; i += 1) {
+      if (corners & (1 << i)) {
+        corners_[i] = value;
+      }
+    }
+  }
+
+  void permute_corners(const std::array<uint8_t, 8> &index) {
+    auto corners = corners_;
+    for (int i = 0; i < 8; i += 1) {
+      corners_[i] = corners[index[i]];
+    }
+  }
+
+  // The value of corner i, at {i & 1, (i >> 1) & 1, i >> 2}.
+  const auto &corner(int i) const { return corners_[i]; }
+
+private:
+  std::array<Vec3f, 8> corners_ = {};
+};
+
+} // namespace voxeloo::galois::lighting
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <VoxelooGeometry/geometry.hpp>
+#include <VoxelooLightKernelry/light_mask.hpp>
+
+namespace voxeloo::galois::lighting {
+
+static constexpr uint32_t kLightStatsBlockSide = 4;
+
+// Statistics of the light masks of a chunk, gathered in one pass over them in
+// storage order. Light is in quantized levels from 0 to 15, with masks
+// deferring quantization quantized as is.
+struct LightStats {
+  Vec3u min = {0, 0, 0};    // Least light of any corner, per channel.
+  Vec3u max = {0, 0, 0};    // Most light of any corner, per channel.
+  uint32_t dark_voxels = 0; // Voxels with every corner at level 0.
+  uint32_t lit_voxels = 0;  // Voxels with every corner at level 15.
+
+  // If set before lighting, coarse receives the average corner light of each
+  // 4x4x4 block of voxels, stored in the linear layout over coarse_shape, the
+  // chunk shape divided by 4 and rounded up.
+  bool with_coarse = false;
+  Vec3u coarse_shape = {0, 0, 0};
+  std::vector<Vec3f> coarse;
+
+  void clear(Vec3u shape) {
+    min = {15, 15, 15};
+    max = {0, 0, 0};
+    dark_voxels = lit_voxels = 0;
+    voxels_ = 0;
+    coarse_shape = {0, 0, 0};
+    coarse.clear();
+    if (with_coarse) {
+      coarse_shape = {block_count(shape.x), block_count(shape.y),
+                      block_count(shape.z)};
+      coarse.assign(size_t(coarse_shape.x) * coarse_shape.y * coarse_shape.z,
+                    Vec3f{0.0, 0.0, 0.0});
+    }
+    shape_ = shape;
+  }
+
+  // Records the final corners of a voxel, packed as by PackedLightMask::pack.
+  void record(Vec3u voxel, const std::array<uint16_t, 8> &corners) {
+    // Most voxels are fully lit or fully dark, so all their corners are alike
+    // and need reducing only once.
+    bool uniform = true;
+    for (int i = 1; i < 8; i += 1) {
+      uniform &= corners[i] == corners[0];
+    }
+    uint16_t all = corners[0], any = corners[0];
+    Vec3u sum = {0, 0, 0};
+    if (uniform) {
+      auto value = reduce(corners[0]);
+      sum = {8 * value.x, 8 * value.y, 8 * value.z};
+    } else {
+      for (auto bits : corners) {
+        sum += reduce(bits);
+        all &= bits;
+        any |= bits;
+      }
+    }
+    dark_voxels += (any & 0xfff) == 0;
+    lit_voxels += (all & 0xfff) == 0xfff;
+    voxels_ += 1;
+
+    if (with_coarse) {
+      coarse[coarse_index(voxel)] += sum.to<float>();
+    }
+  }
+
+  // Turns the coarse sums into averages. Blocks on the far sides of chunks
+  // whose shape is not a multiple of 4 average over the voxels they hold.
+  void finish() {
+    if (voxels_ == 0) {
+      min = {0, 0, 0};
+    }
+    for (uint32_t z = 0; z < coarse_shape.z; z += 1) {
+      for (uint32_t y = 0; y < coarse_shape.y; y += 1) {
+        for (uint32_t x = 0; x < coarse_shape.x; x += 1) {
+          auto corners = 8 * block_extent(shape_.x, x) *
+                         block_extent(shape_.y, y) * block_extent(shape_.z, z);
+          auto &block = coarse[x + coarse_shape.x * (y + coarse_shape.y * z)];
+          block = block / float(corners);
+        }
+      }
+    }
+  }
+
+private:
+  Vec3u reduce(uint16_t bits) {
+    auto value = PackedLightMask::unpack(bits);
+    min = {std::min(min.x, value.x), std::min(min.y, value.y),
+           std::min(min.z, value.z)};
+    max = {std::max(max.x, value.x), std::max(max.y, value.y),
+           std::max(max.z, value.z)};
+    return value;
+  }
+
+  static uint32_t block_count(uint32_t side) {
+    return (side + kLightStatsBlockSide - 1) / kLightStatsBlockSide;
+  }
+
+  static uint32_t block_extent(uint32_t side, uint32_t block) {
+    return std::min(kLightStatsBlockSide, side - block * kLightStatsBlockSide);
+  }
+
+  size_t coarse_index(Vec3u voxel) const {
+    auto x = voxel.x / kLightStatsBlockSide;
+    auto y = voxel.y / kLightStatsBlockSide;
+    auto z = voxel.z / kLightStatsBlockSide;
+    return x + coarse_shape.x * (y + size_t(coarse_shape.y) * z);
+  }
+
+  Vec3u shape_ = {0, 0, 0};
+  size_t voxels_ = 0;
+};
+
+} // namespace voxeloo::galois::lighting
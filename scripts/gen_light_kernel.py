@@ -168,10 +168,8 @@ def group_code(mask):
         for j in component:
             sum_code.append(f"sum += samples[{j}];")
 
-        set_code = []
-        for j in component:
-            dz, dy, dx = zyx(j)
-            set_code.append(f"out.set({{{dx}, {dy}, {dz}}}, value);")
+        corners = sum(1 << j for j in component)
+        set_code = f"set_corners(out, 0b{corners:08b}, value);"
 
         code.append(
             Template(
@@ -182,7 +180,7 @@ def group_code(mask):
                     $sum_code
 
                     // Quantize the vertex light value.
-                    auto value = quantize_light_value(sum / 8.0f);
+                    auto value = encode_light_value<LightMask>(sum / 8.0f);
 
                     // Emit the final quantized light value for each corner.
                     $set_code
@@ -192,7 +190,7 @@ def group_code(mask):
             .substitute(
                 component=component_count,
                 sum_code="\n".join(sum_code),
-                set_code="\n".join(set_code),
+                set_code=set_code,
             )
             .strip()
         )
@@ -215,14 +213,24 @@ def groups_code():
             return (15.0f * clamp(value, 0.0f, 1.0f) + Vec3f{0.5, 0.5, 0.5}).to<uint32_t>();
         }
 
+        // Light masks holding Vec3f values receive the average light of each corner
+        // as is, deferring quantization until after the kernel has run.
+        template <typename LightMask>
+        inline auto encode_light_value(Vec3f value) {
+            if constexpr (std::is_same_v<light_mask_value_t<LightMask>, Vec3f>) {
+                return value;
+            } else {
+                return quantize_light_value(value);
+            }
+        }
+
         template <typename LightMask>
         inline auto group_mask(const std::array<Vec3f, 8>& samples, int group) {
             LightMask out;
             switch (group) {
                 $case_code
                 default:
-                std::cout << "Invalid isomorphism group";
-                //CHECK_UNREACHABLE("Invalid isomorphism group");
+                assert(false && "Invalid isomorphism group");
             }
             return out;
          }
@@ -255,6 +263,43 @@ def isomorphism_code():
     )
 
 
+def mask_components_code():
+    zyx = lambda i: (
+        (i // 4) % 2,
+        (i // 2) % 2,
+        (i // 1) % 2,
+    )
+
+    entry_code = []
+    for key in range(256):
+        mask = key_to_mask(key)
+        corners = [
+            sum(1 << j for j in component)
+            for component in mask_components(mask)
+            if mask[zyx(component[0])]
+        ]
+        corners += [0] * (4 - len(corners))
+        entry_code.append(
+            "{" + ", ".join(f"0x{c:02x}" for c in corners) + "},"
+        )
+
+    return (
+        Template(
+            """
+        // The open components of each occlusion mask as corner masks, where bit i
+        // selects corner i. Unused entries are 0.
+        static constexpr std::array<std::array<uint8_t, 4>, 256> kComponentLut = {{
+            $entry
+        }};
+        """
+        )
+        .substitute(
+            entry="\n".join(entry_code),
+        )
+        .strip()
+    )
+
+
 def permute_samples_code():
     case_code = []
     for i, permute in enumerate(get_permutations()):
@@ -273,8 +318,7 @@ def permute_samples_code():
             switch (permute) {
                 $case_code
                 default:
-                std::cout << "Invalid permutation";
-                //CHECK_UNREACHABLE("Invalid permutation");
+                assert(false && "Invalid permutation");
             }
             return out;
          }
@@ -302,8 +346,7 @@ def reflect_samples_code():
             switch (reflect) {
                 $case_code
                 default:
-                std::cout << "Invalid reflection";
-                //CHECK_UNREACHABLE("Invalid reflection");
+                assert(false && "Invalid reflection");
             }
             return out;
          }
@@ -359,6 +402,10 @@ def transform_samples_code():
     )
 
 
+def corner_lut_entry(index: np.ndarray):
+    return "{" + ", ".join(str(j) for j in index.flatten().tolist()) + "},"
+
+
 def permute_mask_code():
     zyx = lambda i: (
         (i // 4) % 2,
@@ -366,10 +413,12 @@ def permute_mask_code():
         (i // 1) % 2,
     )
 
+    lut_code = []
     case_code = []
     for i, permute in enumerate(get_permutations()):
         case_code.append(f"case {i} /* {permute} */:")
         index = np.transpose(np.arange(8).reshape(2, 2, 2), permute)
+        lut_code.append(corner_lut_entry(index))
         for i, j in enumerate(index.flatten().tolist()):
             if i != j:
                 iz, iy, ix = zyx(i)
@@ -381,19 +430,30 @@ def permute_mask_code():
 
     return Template(
         """
+        static constexpr std::array<std::array<uint8_t, 8>, $len>
+            kPermuteCornerLut = {{
+            $lut_code
+        }};
+
         template <typename LightMask>
         inline auto permute_mask(LightMask mask, int permute) {
-            LightMask out = mask;
-            switch (permute) {
-                $case_code
-                default:
-                std::cout << "Invalid permutation";
-                //CHECK_UNREACHABLE("Invalid permutation");
+            if constexpr (is_bulk_light_mask_v<LightMask>) {
+                mask.permute_corners(kPermuteCornerLut[permute]);
+                return mask;
+            } else {
+                LightMask out = mask;
+                switch (permute) {
+                    $case_code
+                    default:
+                    assert(false && "Invalid permutation");
+                }
+                return out;
             }
-            return out;
          }
          """
     ).substitute(
+        len=len(lut_code),
+        lut_code="\n".join(lut_code),
         case_code="\n".join(case_code),
     )
 
@@ -405,10 +465,12 @@ def reflect_mask_code():
         (i // 1) % 2,
     )
 
+    lut_code = []
     case_code = []
     for i, reflect in enumerate(get_reflections()):
         case_code.append(f"case {i} /* {reflect} */:")
         index = np.flip(np.arange(8).reshape(2, 2, 2), np.where(reflect)[0])
+        lut_code.append(corner_lut_entry(index))
         for i, j in enumerate(index.flatten().tolist()):
             if i != j:
                 iz, iy, ix = zyx(i)
@@ -420,19 +482,30 @@ def reflect_mask_code():
 
     return Template(
         """
+        static constexpr std::array<std::array<uint8_t, 8>, $len>
+            kReflectCornerLut = {{
+            $lut_code
+        }};
+
         template <typename LightMask>
         inline auto reflect_mask(LightMask mask, int reflect) {
-            LightMask out = mask;
-            switch (reflect) {
-                $case_code
-                default:
-                std::cout << "Invalid reflection";
-                //CHECK_UNREACHABLE("Invalid reflection");
+            if constexpr (is_bulk_light_mask_v<LightMask>) {
+                mask.permute_corners(kReflectCornerLut[reflect]);
+                return mask;
+            } else {
+                LightMask out = mask;
+                switch (reflect) {
+                    $case_code
+                    default:
+                    assert(false && "Invalid reflection");
+                }
+                return out;
             }
-            return out;
          }
          """
     ).substitute(
+        len=len(lut_code),
+        lut_code="\n".join(lut_code),
         case_code="\n".join(case_code),
     )
 
@@ -488,7 +561,10 @@ def hpp_code():
 
         #include <algorithm>
         #include <array>
-        #include <iostream>
+        #include <cassert>
+        #include <cstdint>
+        #include <type_traits>
+        #include <utility>
 
         #include <VoxelooGeometry/geometry.hpp>
 
@@ -496,6 +572,92 @@ def hpp_code():
 
         $isomorphism_code
 
+        $mask_components_code
+
+        // Light masks may optionally implement bulk corner writes, which the kernel
+        // then uses in place of per-corner set() and get() calls. Corner i is the
+        // corner at {i & 1, (i >> 1) & 1, i >> 2}.
+        //
+        //   out.set_all(value);              // Sets all 8 corners.
+        //   out.set_corners(corners, value); // Sets corner i if bit i is set.
+        //   out.permute_corners(index);      // Corner i takes corner index[i].
+        template <typename LightMask>
+        using light_mask_value_t = std::decay_t<
+            decltype(std::declval<const LightMask&>().get({0u, 0u, 0u}))>;
+
+        template <typename LightMask, typename = void>
+        struct is_bulk_light_mask : std::false_type {};
+
+        template <typename LightMask>
+        struct is_bulk_light_mask<
+            LightMask,
+            std::void_t<
+                decltype(std::declval<LightMask&>().set_all(
+                    std::declval<light_mask_value_t<LightMask>>())),
+                decltype(std::declval<LightMask&>().set_corners(
+                    uint8_t{}, std::declval<light_mask_value_t<LightMask>>())),
+                decltype(std::declval<LightMask&>().permute_corners(
+                    std::declval<const std::array<uint8_t, 8>&>()))>>
+            : std::true_type {};
+
+        template <typename LightMask>
+        inline constexpr bool is_bulk_light_mask_v =
+            is_bulk_light_mask<LightMask>::value;
+
+        template <typename LightMask, typename Value>
+        inline void set_corners(LightMask& out, uint8_t corners, const Value& value) {
+            if constexpr (is_bulk_light_mask_v<LightMask>) {
+                out.set_corners(corners, value);
+            } else {
+                for (uint32_t i = 0; i < 8; i += 1) {
+                    if (corners & (1 << i)) {
+                        out.set({i & 1, (i >> 1) & 1, i >> 2}, value);
+                    }
+                }
+            }
+        }
+
+        // Light masks may also optionally record, for each corner, the number of
+        // corners in the open component it belongs to, from 0 for an occluded corner up
+        // to 8. The kernel fills these in from the same decoded components as the
+        // light, in the same pass.
+        //
+        //   out.set_component_size(corners, size); // Sets corner i if bit i is set.
+        //   out.component_size(pos);               // Gets the corner at pos.
+        template <typename LightMask, typename = void>
+        struct is_occlusion_light_mask : std::false_type {};
+
+        template <typename LightMask>
+        struct is_occlusion_light_mask<
+            LightMask,
+            std::void_t<
+                decltype(std::declval<LightMask&>().set_component_size(
+                    uint8_t{}, uint32_t{})),
+                decltype(std::declval<const LightMask&>().component_size(
+                    {0u, 0u, 0u}))>>
+            : std::true_type {};
+
+        template <typename LightMask>
+        inline constexpr bool is_occlusion_light_mask_v =
+            is_occlusion_light_mask<LightMask>::value;
+
+        constexpr uint32_t count_corners(uint8_t corners) {
+            uint32_t count = 0;
+            for (uint32_t i = 0; i < 8; i += 1) {
+                count += (corners >> i) & 1;
+            }
+            return count;
+        }
+
+        template <typename LightMask>
+        inline void set_component_sizes(LightMask& out, uint8_t occlusion_mask) {
+            for (auto corners : kComponentLut[occlusion_mask]) {
+                if (corners) {
+                    out.set_component_size(corners, count_corners(corners));
+                }
+            }
+        }
+
         $groups_code
 
         $permute_samples_code
@@ -523,7 +685,11 @@ def hpp_code():
             auto light_mask = group_mask<LightMask>(group_samples, group);
 
             // Transform the light mask to the final output.
-            return transform_mask<LightMask>(light_mask, occlusion_mask);
+            auto out = transform_mask<LightMask>(light_mask, occlusion_mask);
+            if constexpr (is_occlusion_light_mask_v<LightMask>) {
+                set_component_sizes(out, occlusion_mask);
+            }
+            return out;
         }
 
         template <typename LightMask>
@@ -536,17 +702,24 @@ def hpp_code():
             }
 
             // Quantize the vertex light value.
-            auto value = quantize_light_value(sum / 8.0f);
+            auto value = encode_light_value<LightMask>(sum / 8.0f);
 
             // Write the output to each corner.
             LightMask out;
-            for (auto dz : {0u, 1u}) {
-                for (auto dy : {0u, 1u}) {
-                    for (auto dx : {0u, 1u}) {
-                        out.set({dx, dy, dz}, value);
+            if constexpr (is_bulk_light_mask_v<LightMask>) {
+                out.set_all(value);
+            } else {
+                for (auto dz : {0u, 1u}) {
+                    for (auto dy : {0u, 1u}) {
+                        for (auto dx : {0u, 1u}) {
+                            out.set({dx, dy, dz}, value);
+                        }
                     }
                 }
             }
+            if constexpr (is_occlusion_light_mask_v<LightMask>) {
+                out.set_component_size(0xff, 8);
+            }
             return out;
         }
 
@@ -554,6 +727,7 @@ def hpp_code():
         """
     ).substitute(
         isomorphism_code=isomorphism_code(),
+        mask_components_code=mask_components_code(),
         groups_code=groups_code(),
         permute_samples_code=permute_samples_code(),
         reflect_samples_code=reflect_samples_code(),
@@ -0,0 +1,35 @@
+#include <VoxelooLightKernelry/light_batch.hpp>
+
+// Explicit instantiations of the batch lighting API for the library provided
+// mask types, matching the extern declarations in light_batch_fwd.hpp.
+
+namespace voxeloo::galois::lighting {
+
+template void apply_light_kernel_batch<PackedLightMask>(
+    const LightChunk &, PackedLightMask *, LightLayout, std::nullptr_t,
+    LightStats *);
+template void apply_light_kernel_batch<PackedLightMask>(
+    const LightChunk &, PackedLightMask *, LightLayout, LightDelta *,
+    LightStats *);
+template void apply_light_kernel_batch<DeferredLightMask>(
+    const LightChunk &, DeferredLightMask *, LightLayout, std::nullptr_t,
+    LightStats *);
+template void apply_light_kernel_batch<DeferredLightMask>(
+    const LightChunk &, DeferredLightMask *, LightLayout, LightDelta *,
+    LightStats *);
+template void apply_light_kernel_batch<PackedLightOcclusionMask>(
+    const LightChunk &, PackedLightOcclusionMask *, LightLayout,
+    std::nullptr_t, LightStats *);
+template void compute_light_stats<PackedLightMask>(const PackedLightMask *,
+                                                   Vec3u, LightLayout,
+                                                   LightStats &);
+template void compute_light_stats<DeferredLightMask>(const DeferredLightMask *,
+                                                     Vec3u, LightLayout,
+                                                     LightStats &);
+template void compute_light_stats<PackedLightOcclusionMask>(
+    const PackedLightOcclusionMask *, Vec3u, LightLayout, LightStats &);
+template void quantize_light_batch<PackedLightMask>(const DeferredLightMask *,
+                                                    size_t, Vec3f,
+                                                    PackedLightMask *);
+
+} // namespace voxeloo::galois::lighting
@@ -0,0 +1,418 @@
+// Checks the batch kernel and the formats around it against straightforward
+// reference computations. Exits with a failure status if any check fails.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <VoxelooGeometry/geometry.hpp>
+#include <VoxelooLightKernelry/light_batch.hpp>
+#include <VoxelooLightKernelry/light_cache.hpp>
+#include <VoxelooLightKernelry/light_chunk_io.hpp>
+#include <VoxelooLightKernelry/light_delta.hpp>
+#include <VoxelooLightKernelry/light_layout.hpp>
+#include <VoxelooLightKernelry/light_mask.hpp>
+#include <VoxelooLightKernelry/light_stats.hpp>
+
+using namespace voxeloo;
+using namespace voxeloo::galois::lighting;
+
+namespace {
+
+constexpr LightLayout kLayouts[] = {LightLayout::kLinear, LightLayout::kMorton,
+                                    LightLayout::kBrick4, LightLayout::kBrick8};
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << "\n";
+    failures += 1;
+  }
+}
+
+Vec3u corner_pos(uint32_t i) { return {i & 1, (i >> 1) & 1, i >> 2}; }
+
+template <typename Vec>
+bool same_vec(const Vec &a, const Vec &b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+// A chunk with a shape that is not a multiple of any brick side, random
+// occupancy and random light.
+LightChunkData make_chunk(uint32_t seed) {
+  LightChunkData data;
+  data.origin = {-32, 0, 64};
+  data.shape = {13, 6, 9};
+  auto size = layout_size(LightLayout::kLinear, padded_shape(data.chunk()));
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  for (size_t i = 0; i < size; i += 1) {
+    data.occupancy.push_back(unit(rng) < 0.4f);
+    data.samples.push_back({unit(rng), unit(rng), unit(rng)});
+  }
+  return data;
+}
+
+// Lights a recorded chunk with its inputs copied into the given layout.
+template <typename LightMask>
+auto light_chunk(const LightChunkData &data, LightLayout in_layout,
+                 LightLayout out_layout) {
+  std::vector<Vec3f> samples;
+  std::vector<uint8_t> occupancy;
+  relayout_light_chunk(data, in_layout, samples, occupancy);
+  LightChunk chunk{data.shape, in_layout, samples.data(), occupancy.data()};
+  std::vector<LightMask> masks(layout_size(out_layout, data.shape));
+  apply_light_kernel_batch(chunk, masks.data(), out_layout);
+  return masks;
+}
+
+void test_layouts() {
+  auto data = make_chunk(1);
+  auto expected = light_chunk<PackedLightMask>(data, LightLayout::kLinear,
+                                               LightLayout::kLinear);
+  for (auto in_layout : kLayouts) {
+    for (auto out_layout : kLayouts) {
+      auto masks = light_chunk<PackedLightMask>(data, in_layout, out_layout);
+      bool same = true;
+      traverse_layout(LightLayout::kLinear, data.shape, [&](Vec3u pos) {
+        same &= masks[layout_index(out_layout, data.shape, pos)] ==
+                expected[layout_index(LightLayout::kLinear, data.shape, pos)];
+      });
+      check(same, "every layout pair gives the linear output");
+    }
+  }
+}
+
+void test_occlusion() {
+  auto data = make_chunk(2);
+  auto masks = light_chunk<PackedLightOcclusionMask>(
+      data, LightLayout::kLinear, LightLayout::kLinear);
+
+  // Light each vertex on its own: corner c of a voxel is the vertex at offset
+  // c, where the voxel is its opposite corner.
+  auto padded = padded_shape(data.chunk());
+  bool same = true;
+  traverse_layout(LightLayout::kLinear, data.shape, [&](Vec3u pos) {
+    PackedLightOcclusionMask expected;
+    for (uint32_t c = 0; c < 8; c += 1) {
+      std::array<Vec3f, 8> samples;
+      uint8_t occlusion_mask = 0;
+      for (uint32_t j = 0; j < 8; j += 1) {
+        auto i = layout_index(LightLayout::kLinear, padded,
+                              pos + corner_pos(c) + corner_pos(j));
+        samples[j] = data.samples[i];
+        occlusion_mask |= !data.occupancy[i] << (7 - j);
+      }
+      auto vertex = apply_light_kernel_with_occlusion<PackedLightOcclusionMask>(
+          occlusion_mask, samples);
+      auto opposite = corner_pos(7 - c);
+      expected.set(corner_pos(c), vertex.get(opposite));
+      expected.set_component_size(1 << c, vertex.component_size(opposite));
+    }
+    same &= masks[layout_index(LightLayout::kLinear, data.shape, pos)] ==
+            expected;
+  });
+  check(same, "occlusion masks match lighting each vertex on its own");
+}
+
+template <typename LightMask>
+void test_bucketed() {
+  auto data = make_chunk(10);
+  for (auto layout : kLayouts) {
+    std::vector<Vec3f> samples;
+    std::vector<uint8_t> occupancy;
+    relayout_light_chunk(data, layout, samples, occupancy);
+    LightChunk chunk{data.shape, layout, samples.data(), occupancy.data()};
+    std::vector<LightMask> expected(layout_size(layout, data.shape));
+    std::vector<LightMask> actual(expected.size());
+    apply_light_kernel_batch(chunk, expected.data(), layout);
+    apply_light_kernel_batch_bucketed(chunk, actual.data(), layout);
+    bool same = true;
+    traverse_layout(LightLayout::kLinear, data.shape, [&](Vec3u pos) {
+      auto i = layout_index(layout, data.shape, pos);
+      for (uint32_t c = 0; c < 8; c += 1) {
+        same &= same_vec(expected[i].get(corner_pos(c)),
+                         actual[i].get(corner_pos(c)));
+      }
+    });
+    check(same, "bucketed output matches batch output");
+  }
+}
+
+void test_quantize() {
+  auto data = make_chunk(11);
+  auto deferred = light_chunk<DeferredLightMask>(data, LightLayout::kLinear,
+                                                 LightLayout::kLinear);
+  // A uniform mask and one with a single odd corner.
+  deferred.emplace_back().set_all({0.5f, 0.25f, 1.0f});
+  deferred.emplace_back().set_all({0.5f, 0.25f, 1.0f});
+  deferred.back().set(corner_pos(5), {0.0f, 1.0f, 0.5f});
+
+  Vec3f scale{1.0f, 0.5f, 0.0f};
+  std::vector<PackedLightMask> masks(deferred.size());
+  quantize_light_batch(deferred.data(), deferred.size(), scale, masks.data());
+  bool same = true;
+  for (size_t i = 0; i < deferred.size(); i += 1) {
+    for (uint32_t c = 0; c < 8; c += 1) {
+      auto value = deferred[i].get(corner_pos(c));
+      auto expected = quantize_light_value(
+          {value.x * scale.x, value.y * scale.y, value.z * scale.z});
+      same &= same_vec(masks[i].get(corner_pos(c)), expected);
+    }
+  }
+  check(same, "quantized masks match quantizing each corner");
+}
+
+void test_stats() {
+  auto data = make_chunk(3);
+  for (auto layout : kLayouts) {
+    std::vector<Vec3f> samples;
+    std::vector<uint8_t> occupancy;
+    relayout_light_chunk(data, layout, samples, occupancy);
+    LightChunk chunk{data.shape, layout, samples.data(), occupancy.data()};
+    std::vector<DeferredLightMask> masks(layout_size(layout, data.shape));
+    LightStats stats;
+    stats.with_coarse = true;
+    apply_light_kernel_batch(chunk, masks.data(), layout, nullptr, &stats);
+
+    // Rescan the output.
+    Vec3u min{15, 15, 15}, max{0, 0, 0};
+    uint32_t dark = 0, lit = 0;
+    std::vector<Vec3f> coarse(stats.coarse.size(), Vec3f{0.0, 0.0, 0.0});
+    std::vector<float> corners(coarse.size(), 0.0f);
+    traverse_layout(LightLayout::kLinear, data.shape, [&](Vec3u pos) {
+      const auto &mask = masks[layout_index(layout, data.shape, pos)];
+      uint32_t any = 0, all = 0xfff;
+      auto b = pos.x / 4 + stats.coarse_shape.x *
+                               (pos.y / 4 + stats.coarse_shape.y * (pos.z / 4));
+      for (uint32_t c = 0; c < 8; c += 1) {
+        auto bits = pack_light_value(mask.get(corner_pos(c))) & 0xfff;
+        auto value = PackedLightMask::unpack(bits);
+        min = {std::min(min.x, value.x), std::min(min.y, value.y),
+               std::min(min.z, value.z)};
+        max = {std::max(max.x, value.x), std::max(max.y, value.y),
+               std::max(max.z, value.z)};
+        any |= bits;
+        all &= bits;
+        coarse[b] += value.to<float>();
+        corners[b] += 1.0f;
+      }
+      dark += any == 0;
+      lit += all == 0xfff;
+    });
+
+    check(same_vec(stats.min, min) && same_vec(stats.max, max),
+          "stats light range");
+    check(stats.dark_voxels == dark, "stats dark voxels");
+    check(stats.lit_voxels == lit, "stats lit voxels");
+    bool close = coarse.size() == 4 * 2 * 3;
+    for (size_t i = 0; close && i < coarse.size(); i += 1) {
+      auto diff = coarse[i] / corners[i] - stats.coarse[i];
+      close = std::max({std::fabs(diff.x), std::fabs(diff.y),
+                        std::fabs(diff.z)}) < 1e-4f;
+    }
+    check(close, "stats coarse averages");
+  }
+}
+
+void test_delta() {
+  auto data = make_chunk(4);
+  for (auto layout : kLayouts) {
+    std::vector<Vec3f> samples;
+    std::vector<uint8_t> occupancy;
+    relayout_light_chunk(data, layout, samples, occupancy);
+    LightChunk chunk{data.shape, layout, samples.data(), occupancy.data()};
+    std::vector<PackedLightMask> masks(layout_size(layout, data.shape));
+    apply_light_kernel_batch(chunk, masks.data(), layout);
+    auto before = masks;
+
+    // Relight after opening, closing and relighting a few voxels.
+    auto padded = padded_shape(chunk);
+    for (Vec3u pos : {Vec3u{1, 1, 1}, Vec3u{7, 3, 5}, Vec3u{14, 7, 10}}) {
+      auto i = layout_index(layout, padded, pos);
+      occupancy[i] ^= 1;
+      samples[i] = {1.0, 0.5, 0.0};
+    }
+    LightDelta delta;
+    apply_light_kernel_batch(chunk, masks.data(), layout, &delta);
+
+    // The delta holds exactly the corners that differ.
+    std::vector<LightDeltaEntry> diff;
+    traverse_layout(LightLayout::kLinear, data.shape, [&](Vec3u pos) {
+      auto i = layout_index(layout, data.shape, pos);
+      LightDeltaEntry entry{static_cast<uint32_t>(layout_index(
+                                LightLayout::kLinear, data.shape, pos)),
+                            0,
+                            {}};
+      for (uint32_t c = 0; c < 8; c += 1) {
+        if (masks[i].corner(c) != before[i].corner(c)) {
+          entry.corners |= 1 << c;
+          entry.values[c] = masks[i].corner(c);
+        }
+      }
+      if (entry.corners) {
+        diff.push_back(entry);
+      }
+    });
+    bool same = !diff.empty() && diff.size() == delta.entries().size();
+    for (size_t i = 0; same && i < diff.size(); i += 1) {
+      const auto &a = diff[i], &b = delta.entries()[i];
+      same = a.voxel == b.voxel && a.corners == b.corners;
+      for (uint32_t c = 0; same && c < 8; c += 1) {
+        same = !(a.corners & (1 << c)) || a.values[c] == b.values[c];
+      }
+    }
+    check(same, "delta matches the full diff");
+
+    // Serialized deltas round-trip and rebuild the relit masks.
+    std::vector<uint8_t> bytes;
+    serialize_light_delta(delta.entries(), bytes);
+    std::vector<LightDeltaEntry> entries;
+    auto voxels = layout_size(LightLayout::kLinear, data.shape);
+    check(deserialize_light_delta(bytes.data(), bytes.size(), voxels, entries),
+          "delta deserializes");
+    apply_light_delta(entries, data.shape, layout, before.data());
+    check(before == masks, "applied delta gives the relit masks");
+
+    check(!deserialize_light_delta(bytes.data(), bytes.size() - 1, voxels,
+                                   entries),
+          "truncated delta is rejected");
+    check(!deserialize_light_delta(bytes.data(), bytes.size(),
+                                   delta.entries().back().voxel, entries),
+          "out of range delta is rejected");
+
+    // A no-op relight changes nothing.
+    apply_light_kernel_batch(chunk, masks.data(), layout, &delta);
+    check(delta.entries().empty(), "unchanged relight has an empty delta");
+  }
+
+  // Varints over 32 bits are rejected.
+  std::vector<uint8_t> bytes;
+  write_varint(bytes, 0xffffffff);
+  const uint8_t *cursor = bytes.data();
+  uint32_t value;
+  check(read_varint(cursor, bytes.data() + bytes.size(), value) &&
+            value == 0xffffffff,
+        "largest varint round-trips");
+  bytes.back() = 0x1f;
+  cursor = bytes.data();
+  check(!read_varint(cursor, bytes.data() + bytes.size(), value),
+        "overlong varint is rejected");
+}
+
+void test_chunk_io() {
+  auto data = make_chunk(5);
+  std::stringstream stream;
+  write_light_chunk(stream, data);
+  write_light_chunk(stream, make_chunk(6));
+  auto corpus = read_light_corpus(stream);
+  check(corpus.size() == 2, "corpus holds every record");
+  check(corpus.size() == 2 && same_vec(corpus[0].origin, data.origin) &&
+            same_vec(corpus[0].shape, data.shape) &&
+            corpus[0].occupancy == data.occupancy &&
+            std::equal(corpus[0].samples.begin(), corpus[0].samples.end(),
+                       data.samples.begin(), data.samples.end(),
+                       same_vec<Vec3f>),
+        "chunk record round-trips");
+
+  auto bytes = stream.str();
+  stream.clear();
+  stream.str(bytes.substr(0, bytes.size() / 4));
+  LightChunkData back;
+  check(!read_light_chunk(stream, back), "truncated chunk record is rejected");
+}
+
+void test_baked() {
+  auto data = make_chunk(7);
+  auto masks = light_chunk<PackedLightMask>(data, LightLayout::kLinear,
+                                            LightLayout::kLinear);
+  std::stringstream stream;
+  std::vector<uint8_t> buffer;
+  write_baked_light_chunk(stream, data.origin, data.shape, masks.data(),
+                          buffer);
+  auto bytes = stream.str();
+
+  for (auto layout : kLayouts) {
+    stream.clear();
+    stream.str(bytes);
+    Vec3i origin;
+    Vec3u shape;
+    std::vector<PackedLightMask> back;
+    check(read_baked_light_chunk(stream, origin, shape, layout, back) &&
+              same_vec(origin, data.origin) && same_vec(shape, data.shape),
+          "baked record reads back");
+    bool same = back.size() == layout_size(layout, data.shape);
+    traverse_layout(LightLayout::kLinear, data.shape, [&](Vec3u pos) {
+      same = same &&
+             back[layout_index(layout, shape, pos)] ==
+                 masks[layout_index(LightLayout::kLinear, shape, pos)];
+    });
+    check(same, "baked record round-trips");
+  }
+}
+
+void test_cache() {
+  auto data = make_chunk(8);
+  LightCache<PackedLightMask> cache(64 << 10);
+  auto first = cache.light(data.chunk());
+  auto again = cache.light(data.chunk());
+  check(first == again, "cache returns the cached result");
+  check(*first == light_chunk<PackedLightMask>(data, LightLayout::kLinear,
+                                               LightLayout::kLinear),
+        "cached result matches a relight");
+  check(cache.light(data.chunk(), LightLayout::kBrick4) != first,
+        "output layout is part of the key");
+
+  // Slots that bricks round the volumes up with are not hashed.
+  std::vector<Vec3f> samples;
+  std::vector<uint8_t> occupancy;
+  relayout_light_chunk(data, LightLayout::kBrick8, samples, occupancy);
+  LightChunk chunk{data.shape, LightLayout::kBrick8, samples.data(),
+                   occupancy.data()};
+  auto hash = hash_light_chunk(chunk, LightLayout::kLinear);
+  occupancy.back() ^= 1;
+  check(hash_light_chunk(chunk, LightLayout::kLinear) == hash,
+        "padding slots are not hashed");
+  occupancy[layout_index(LightLayout::kBrick8, padded_shape(chunk),
+                         {3, 2, 1})] ^= 1;
+  check(hash_light_chunk(chunk, LightLayout::kLinear) != hash,
+        "input slots are hashed");
+
+  // Results past the capacity evict the least recently used ones.
+  auto stats = cache.stats();
+  check(stats.hits == 1 && stats.misses == 2 && stats.entries == 2,
+        "cache counts hits and misses");
+  LightCache<PackedLightMask> small(first->size() * sizeof(PackedLightMask));
+  small.light(data.chunk());
+  small.light(make_chunk(9).chunk());
+  check(small.stats().entries == 1 && small.stats().evictions == 1,
+        "cache evicts past its capacity");
+}
+
+} // namespace
+
+int main() {
+  test_layouts();
+  test_occlusion();
+  test_bucketed<PackedLightMask>();
+  test_bucketed<DeferredLightMask>();
+  test_bucketed<PackedLightOcclusionMask>();
+  test_quantize();
+  test_stats();
+  test_delta();
+  test_chunk_io();
+  test_baked();
+  test_cache();
+  if (failures) {
+    std::cerr << failures << " checks failed\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "all checks passed\n";
+  return EXIT_SUCCESS;
+}
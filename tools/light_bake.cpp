@@ -0,0 +1,276 @@
+// Bakes the lighting of a world stored as a directory of chunk files, each
+// holding one or more chunk records as written by write_light_chunk, into a
+// mirrored directory of baked light files (see write_baked_light_chunk).
+//
+//   light_bake --input DIR --output DIR [--threads N] [--force]
+//
+// Files are baked in path order by a pool of worker threads, each streaming
+// one file a record at a time, so memory use is bounded by the thread count
+// rather than the world size. Every output is written to a temporary file and
+// renamed into place once complete, and outputs that already exist are
+// skipped, so an interrupted bake resumes where it left off. Pass --force to
+// rebake everything. Baked files, and the output directory when it lies within
+// the input, are never taken for chunk files.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <VoxelooLightKernelry/light_batch.hpp>
+#include <VoxelooLightKernelry/light_chunk_io.hpp>
+#include <VoxelooLightKernelry/light_mask.hpp>
+
+using namespace voxeloo;
+using namespace voxeloo::galois::lighting;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+static constexpr const char *kBakedExtension = ".vlkb";
+static constexpr const char *kTmpExtension = ".tmp";
+
+struct Options {
+  fs::path input;
+  fs::path output;
+  uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+  bool force = false;
+};
+
+struct Job {
+  fs::path input;
+  fs::path output;
+};
+
+struct Progress {
+  std::atomic<uint64_t> files = 0;
+  std::atomic<uint64_t> failed = 0;
+  std::atomic<uint64_t> chunks = 0;
+  std::atomic<uint64_t> bytes_read = 0;
+  std::atomic<uint64_t> bytes_written = 0;
+};
+
+std::mutex log_mutex;
+
+void log_error(const std::string &message) {
+  std::lock_guard<std::mutex> lock(log_mutex);
+  std::cerr << message << "\n";
+}
+
+// Bakes every record of one chunk file. The output only appears under its
+// final name once it has been completely written.
+bool bake_file(const Job &job, Progress &progress) {
+  std::ifstream in(job.input, std::ios::binary);
+  if (!in) {
+    log_error("Cannot open " + job.input.string());
+    return false;
+  }
+
+  std::error_code error;
+  fs::create_directories(job.output.parent_path(), error);
+  auto tmp = job.output;
+  tmp += kTmpExtension;
+  std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    log_error("Cannot create " + tmp.string());
+    return false;
+  }
+
+  auto fail = [&](const std::string &message) {
+    log_error(message);
+    out.close();
+    fs::remove(tmp, error);
+    return false;
+  };
+
+  LightChunkData data;
+  std::vector<PackedLightMask> masks;
+  std::vector<uint8_t> buffer;
+  while (in.peek() != std::ifstream::traits_type::eof()) {
+    if (!read_light_chunk(in, data)) {
+      return fail("Malformed chunk record in " + job.input.string());
+    }
+
+    // The kernel writes every corner, so masks need no clearing between
+    // records, and the lit voxels are serialized straight from them.
+    masks.resize(layout_size(LightLayout::kLinear, data.shape));
+    apply_light_kernel_batch(data.chunk(), masks.data());
+    write_baked_light_chunk(out, data.origin, data.shape, masks.data(),
+                            buffer);
+
+    progress.chunks += 1;
+    progress.bytes_read +=
+        data.occupancy.size() + data.samples.size() * sizeof(Vec3f);
+    progress.bytes_written += buffer.size();
+  }
+
+  out.close();
+  if (!out) {
+    return fail("Cannot write " + tmp.string());
+  }
+  fs::rename(tmp, job.output, error);
+  if (error) {
+    return fail("Cannot rename " + tmp.string() + ": " + error.message());
+  }
+  return true;
+}
+
+bool is_baked_file(const fs::path &path) {
+  auto extension = path.extension();
+  if (extension == kTmpExtension) {
+    extension = path.stem().extension();
+  }
+  return extension == kBakedExtension;
+}
+
+// Lists the chunk files under the input directory in path order, skipping
+// those already baked unless forced. When the output directory lies within the
+// input, it is not descended into, and baked files are never taken for chunk
+// files even when the two directories are the same.
+std::vector<Job> list_jobs(const Options &options, uint64_t &skipped) {
+  std::vector<Job> jobs;
+  std::error_code error;
+  auto output_dir = fs::weakly_canonical(options.output, error);
+  for (auto it = fs::recursive_directory_iterator(options.input);
+       it != fs::recursive_directory_iterator(); ++it) {
+    const auto &entry = *it;
+    if (entry.is_directory() &&
+        fs::weakly_canonical(entry.path(), error) == output_dir) {
+      it.disable_recursion_pending();
+      continue;
+    }
+    if (!entry.is_regular_file() || is_baked_file(entry.path())) {
+      continue;
+    }
+    auto output = options.output / fs::relative(entry.path(), options.input);
+    output += kBakedExtension;
+    if (!options.force && fs::exists(output)) {
+      skipped += 1;
+      continue;
+    }
+    jobs.push_back({entry.path(), output});
+  }
+  std::sort(jobs.begin(), jobs.end(),
+            [](const auto &a, const auto &b) { return a.input < b.input; });
+  return jobs;
+}
+
+void print_progress(const Progress &progress, size_t total, double seconds) {
+  auto mb_read = progress.bytes_read / 1e6;
+  auto mb_written = progress.bytes_written / 1e6;
+  std::lock_guard<std::mutex> lock(log_mutex);
+  std::cout << std::fixed << std::setprecision(1) << "[" << progress.files
+            << "/" << total << " files] " << progress.chunks << " chunks, "
+            << mb_read << " MB read, " << mb_written << " MB written, "
+            << progress.chunks / seconds << " chunks/s, " << mb_read / seconds
+            << " MB/s" << std::endl;
+}
+
+bool try_parse_options(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i += 1) {
+    std::string arg = argv[i];
+    if (arg == "--force") {
+      options.force = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--input") {
+      options.input = value;
+    } else if (arg == "--output") {
+      options.output = value;
+    } else if (arg == "--threads") {
+      options.threads = std::stoul(value);
+    } else {
+      return false;
+    }
+  }
+  return !options.input.empty() && !options.output.empty() &&
+         options.threads > 0;
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+  try {
+    return try_parse_options(argc, argv, options);
+  } catch (const std::exception &) {
+    // std::stoul throws on malformed and out of range numbers.
+    return false;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    std::cerr << "usage: light_bake --input DIR --output DIR [--threads N] "
+                 "[--force]\n";
+    return EXIT_FAILURE;
+  }
+
+  std::error_code error;
+  if (!fs::is_directory(options.input, error)) {
+    std::cerr << "Not a directory: " << options.input.string() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  uint64_t skipped = 0;
+  auto jobs = list_jobs(options, skipped);
+  std::cout << "baking " << jobs.size() << " files with " << options.threads
+            << " threads, " << skipped << " already baked\n";
+
+  Progress progress;
+  std::atomic<size_t> next = 0;
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < std::min<size_t>(options.threads, jobs.size());
+       i += 1) {
+    workers.emplace_back([&] {
+      for (size_t job; (job = next++) < jobs.size();) {
+        if (!bake_file(jobs[job], progress)) {
+          progress.failed += 1;
+        }
+        progress.files += 1;
+      }
+    });
+  }
+
+  auto elapsed = [&] {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return std::max(elapsed.count(), 1e-9);
+  };
+  auto last_report = start;
+  while (progress.files < jobs.size()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (std::chrono::steady_clock::now() - last_report >
+        std::chrono::seconds(1)) {
+      last_report = std::chrono::steady_clock::now();
+      print_progress(progress, jobs.size(), elapsed());
+    }
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  print_progress(progress, jobs.size(), elapsed());
+  if (progress.failed) {
+    std::cerr << progress.failed << " files failed to bake\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}